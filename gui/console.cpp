@@ -39,18 +39,53 @@
 #endif
 #include <SDL3/SDL_events.h>
 #include <SDL3/SDL_stdinc.h>
+#include <SDL3/SDL_time.h>
+#include <algorithm>
+#include <condition_variable>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <regex>
+#include <thread>
 #include <vector>
 
+#ifndef SDL_PLATFORM_WINDOWS
+#include <errno.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
 #include "tetra/util/stb_sprintf.h"
 
 #include "console.h"
+#include "tetra/tetra_core.h"
+#include "tetra/util/command_tokenizer.h"
 #include "tetra/util/convar.h"
+#include "tetra/util/log_file.h"
+#include "tetra/util/log_format.h"
+#include "tetra/util/log_recorder.h"
+#include "tetra/util/text_scan.h"
 
 #define VA_BUF_LEN 2048
-#define ITEM_COUNT_SHRINK_AT 50000
-#define ITEM_COUNT_SHRINK_AMOUNT (ITEM_COUNT_SHRINK_AT / 10)
+#define LOG_QUEUE_SIZE 4096
+#define LOG_QUEUE_INLINE_LEN 256
+#define LOG_QUEUE_SPILL_COUNT 64
+#define LOG_QUEUE_SPILL_LEN VA_BUF_LEN
+#define LOG_STORE_CHUNK_SIZE (16 * 1024)
+#define LOG_STORE_AVG_ITEM_SIZE 128
+#define LOG_SINK_BLOCK_SIZE (64 * 1024)
+#define LOG_SINK_MAX_BLOCKS 64
+#define LOG_FILTER_SYNC_ITEMS 8192
+#define LOG_FILTER_SLICE_ITEMS 4096
+#define LOG_RECENT_ITEMS 16
+#define LOG_SEARCH_BATCH_ITEMS 1024
+#define LOG_SEARCH_BATCH_BYTES (256 * 1024)
+#define LOG_EXPORT_CHUNK_SIZE (64 * 1024)
+#define CONSOLE_EXEC_MAX_DEPTH 16
+#define LOG_RECORDER_DIR "logs"
+#define LOG_RECORDER_PATH LOG_RECORDER_DIR "/recorder.trec"
+#define LOG_RECORDER_PREV_PATH LOG_RECORDER_DIR "/recorder_prev.trec"
+#define LOG_RECENT_TEXT_LEN 512
 
 #define sprintf stbsp_sprintf
 #define snprintf stbsp_snprintf
@@ -76,6 +111,23 @@ struct log_item_t
 
     char* str;
 
+    /**
+     * Display text, the prefix from format_prefix() followed by str, only set for items in log_store_t
+     *
+     * For these items str points into text
+     */
+    char* text;
+
+    /**
+     * If not NULL, then str holds arguments captured by log_format::capture() and must be formatted with this before use
+     */
+    const char* fmt;
+
+    /**
+     * Do not print the item to stdout
+     */
+    bool quiet;
+
     const char* str_fname;
 
     const char* str_func;
@@ -84,10 +136,33 @@ struct log_item_t
 
     dev_console::log_level_t lvl;
 
+    /**
+     * Width of the widest line, in pixels if width_key matches the key it was measured with, otherwise an estimate
+     */
     float line_width;
 
+    /**
+     * Key of the font metrics line_width was measured with, or 0 if line_width is an estimate
+     */
+    Uint32 width_key;
+
     int num_lines;
 
+    /**
+     * Sum of num_lines of every item pushed into log_store_t before this one, set by log_store_t::push_back()
+     */
+    Uint64 lines_before;
+
+    /**
+     * Number of consecutive identical messages from the same callsite this item represents
+     */
+    Uint32 repeat;
+
+    /**
+     * Number of messages from the same callsite dropped by the rate limiter before this one
+     */
+    Uint32 suppressed;
+
     /**
      * Get the color of the log message associated with lvl
      */
@@ -110,7 +185,12 @@ struct log_item_t
         }
     }
 
-    void format_str(char* buf, size_t buf_len)
+    /**
+     * Format the file, function, line, and level prefix
+     *
+     * @returns Length of the prefix
+     */
+    size_t format_prefix(char* buf, size_t buf_len)
     {
         const char* lvl_txt;
         switch (lvl)
@@ -132,239 +212,2891 @@ struct log_item_t
             break;
         }
 
+        int len;
         if (lvl < 0)
-        {
-            size_t slen = strlen(str) + 1;
-            memcpy(buf, str, SDL_min(buf_len, slen));
-            buf[SDL_min(buf_len, slen) - 1] = '\0';
-        }
+            len = 0;
         else if (lvl_txt)
-            snprintf(buf, buf_len, "[%s:%s:%d]%s: %s", str_fname, str_func, line, lvl_txt, str);
+            len = snprintf(buf, buf_len, "[%s:%s:%d]%s: ", str_fname, str_func, line, lvl_txt);
         else
-            snprintf(buf, buf_len, "[%s:%s:%d]: %s", str_fname, str_func, line, str);
+            len = snprintf(buf, buf_len, "[%s:%s:%d]: ", str_fname, str_func, line);
+
+        len = SDL_clamp(len, 0, int(buf_len) - 1);
+        buf[len] = '\0';
+        return len;
     }
-};
 
-// Demonstrate creating a simple console window, with scrolling, filtering, completion and history.
-// For the console example, we are using a more C++ like approach of declaring a class to hold both data and functions.
-struct AppConsole
-{
-#define MAX_INPUT_LENGTH 1024
-    // #define DEBUG_EXEC_MAPPED_COMMAND
-    char InputBuf[MAX_INPUT_LENGTH];
-    ImVector<log_item_t> Items;
-    ImVector<const char*> commands_vec;
-    ImVector<char*> History;
-    int HistoryPos; // -1: new line, 0..History.Size-1 browsing history.
-    ImGuiTextFilter Filter;
-    bool AutoScroll;
-    bool ScrollToBottom;
-    bool forceReclaimFocus;
-    bool console_fullscreen_bool;
-    std::mutex mutex_log;
+    /**
+     * Append the repeat and suppressed counts, if any, to buf
+     *
+     * @param len Length of the string in buf
+     */
+    void append_suffix(char* buf, size_t len, size_t buf_len)
+    {
+        if (repeat <= 1 && !suppressed)
+            return;
 
-    std::unordered_map<std::string, std::function<int(const int, const char**)>> commands_map;
+        if (len && buf[len - 1] == '\n')
+            len--;
+        buf[len] = '\0';
+        if (repeat > 1)
+            len += SDL_max(snprintf(buf + len, buf_len - len, " (x%u)", repeat), 0);
+        len = SDL_min(len, buf_len - 1);
+        if (suppressed)
+            snprintf(buf + len, buf_len - len, " [%u suppressed]", suppressed);
+    }
 
-    AppConsole()
+    void format_str(char* buf, size_t buf_len)
     {
-        forceReclaimFocus = false;
-        ClearLog();
-        memset(InputBuf, 0, sizeof(InputBuf));
-        HistoryPos = -1;
+        size_t len = format_prefix(buf, buf_len);
+        len += SDL_max(snprintf(buf + len, buf_len - len, "%s", str), 0);
+        append_suffix(buf, SDL_min(len, buf_len - 1), buf_len);
+    }
 
-        commands_vec.push_back("help");
-        commands_vec.push_back("history");
-        commands_vec.push_back("echo");
+    /**
+     * Get the full display text of an item in log_store_t
+     *
+     * This is text itself unless a suffix is needed, so that printf work is only done for collapsed or rate limited items
+     *
+     * @param buf Scratch buffer that is used if a suffix is needed
+     */
+    const char* display_text(char* buf, size_t buf_len)
+    {
+        if (repeat <= 1 && !suppressed)
+            return text;
+
+        size_t len = SDL_min(strlen(text), buf_len - 1);
+        memcpy(buf, text, len);
+        buf[len] = '\0';
+        append_suffix(buf, len, buf_len);
+        return buf;
+    }
+};
 
-#ifdef DEBUG_EXEC_MAPPED_COMMAND
-        AddCommand("c", [=](const int argc, const char** argv) -> int {
-            for (int i = 0; i < argc; i++)
-                AddLog("DEBUG_EXEC_MAPPED_COMMAND: argv[%d]=\"%s\"", i, argv[i]);
-            return 0;
-        });
-#endif
+/**
+ * Counters for diagnosing contention in the logging path, printed by the command log_stats
+ */
+struct log_stats_t
+{
+    /** Items pushed into log_queue_t */
+    std::atomic<Uint64> enqueued;
 
-        AddCommand("clear", [=]() -> int {
-            ClearLog();
-            return 0;
-        });
-        AddCommand("_crash_nullptr_dereference", [=]() -> int {
-            char* a = nullptr;
-            a[0] = 0;
+    /** Items moved from log_queue_t to AppConsole::Items */
+    std::atomic<Uint64> drained;
 
-            return 1;
-        });
-        AddCommand("_crash_stackoverflow", [=]() -> int {
-            struct c
-            {
-                int b = 1;
-                void crash()
-                {
-                    if (b != 0)
-                    {
-                        crash();
-                    }
-                }
-            };
-            c b;
-            b.crash();
+    /** Largest number of items moved in a single drain */
+    std::atomic<Uint64> drained_max_batch;
 
-            return 1;
-        });
+    /** Times a producer lost a race with another producer for a queue slot and had to retry */
+    std::atomic<Uint64> push_retries;
 
-        AddCommand("_crash_local_convar", [=]() -> int {
-            convar_int_t cl_crash_local_convar("cl_crash_local_convar", 0, 0, 0, 0);
-            return 1;
-        });
+    /** Times a producer found the queue (Or its spill blocks) full and had to drain it or yield */
+    std::atomic<Uint64> queue_full;
 
-        AddCommand("_con_test_returncode", [=](const int argc, const char* argv[]) -> int {
-            if (argc > 1)
-            {
-                return atoi(argv[1]);
-            }
-            return 1;
-        });
+    /** Items cut to LOG_QUEUE_SPILL_LEN because they were too long for the queue */
+    std::atomic<Uint64> truncated;
 
-        AddCommand("_con_test_log_fatal", [=](const int argc, const char* argv[]) -> int {
-            dc_log_fatal("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
-            return 0;
-        });
+    /** Times AppConsole::mutex_log was held by another thread when a thread went to acquire it */
+    std::atomic<Uint64> lock_contended;
 
-        AddCommand("_con_test_log_error", [=](const int argc, const char* argv[]) -> int {
-            dc_log_error("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
-            return 0;
-        });
+    /** Items collapsed into the previous item because they were identical */
+    std::atomic<Uint64> collapsed;
 
-        AddCommand("_con_test_log_warn", [=](const int argc, const char* argv[]) -> int {
-            dc_log_warn("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
-            return 0;
-        });
+    /** Messages dropped by the per-callsite rate limiter */
+    std::atomic<Uint64> rate_limited;
 
-        AddCommand("_con_test_log_info", [=](const int argc, const char* argv[]) -> int {
-            dc_log("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
-            return 0;
-        });
+    /** Calls to writev() made by log_sink_t */
+    std::atomic<Uint64> stdout_writes;
+};
 
-        AddCommand("_con_test_log_trace", [=](const int argc, const char* argv[]) -> int {
-            dc_log_trace("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
-            return 0;
-        });
+static log_stats_t log_stats;
 
-        AddCommand("_con_test_log_internal", [=](const int argc, const char* argv[]) -> int {
-            dc_log_internal("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
-            return 0;
-        });
+/**
+ * Bounded lock-free multi-producer single-consumer queue for log items
+ *
+ * Based on Dmitry Vyukov's bounded MPMC queue, with consumers serialized by AppConsole::mutex_log
+ *
+ * This is meant to live in zero initialized static storage, to allow logging before static constructors have run
+ * the sequence numbers are stored relative to the slot index (Which lets the initial value of every slot be zero)
+ */
+struct log_queue_t
+{
+    struct slot_t
+    {
+        std::atomic<size_t> seq;
+        log_item_t item;
 
-        AddCommand("_con_test_log_all", [=](const int argc, const char* argv[]) -> int {
-            dc_log_fatal("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
-            dc_log_error("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
-            dc_log_warn("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
-            dc_log("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
-            dc_log_trace("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
-            dc_log_internal("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
-            return 0;
-        });
+        /** Length of item.str, excluding the null terminator */
+        size_t str_len;
 
-        AddCommand("_con_test_log_multiline_internal", [=](const int argc, const char* argv[]) -> int {
-            dc_log_internal("argc = %d, argv[0] = \"%s\"\nline 2\nline 3\nline 4", argc, argv[0]);
-            return 0;
-        });
+        /** Storage for item.str if it fits, otherwise item.str points into a spill block */
+        char str_inline[LOG_QUEUE_INLINE_LEN];
 
-        AddCommand("_con_test_log_multiline_warn", [=](const int argc, const char* argv[]) -> int {
-            dc_log_warn("argc = %d, argv[0] = \"%s\"\nline 2\nline 3\nline 4", argc, argv[0]);
-            return 0;
-        });
+        /** Index + 1 of the spill block holding item.str, 0 if item.str is str_inline */
+        int spill;
+    };
 
-        AddCommand("_con_test_log_multiline_warn_trailing", [=](const int argc, const char* argv[]) -> int {
-            dc_log_warn("argc = %d, argv[0] = \"%s\"\nline 2\nline 3\nline 4\n\n", argc, argv[0]);
-            return 0;
-        });
+    slot_t slots[LOG_QUEUE_SIZE];
 
-        AddCommand("_con_test_log_multiline_error_mult", [=]() -> int {
-            char buf[64];
-            for (int i = 0; i < IM_ARRAYSIZE(buf); i++)
-                buf[i] = (i % 2 == 0) ? 'X' : '\n';
-            buf[IM_ARRAYSIZE(buf) - 1] = '\n';
-            for (int i = 1; i < IM_ARRAYSIZE(buf); i += 2)
-            {
-                dc_log_error("Num newlines: %d%.*send", i, i, buf);
-            }
-            return 0;
-        });
+    /** Storage for items too long for slot_t::str_inline, so that producers never allocate */
+    char spill[LOG_QUEUE_SPILL_COUNT][LOG_QUEUE_SPILL_LEN];
 
-        AddCommand("_con_test_log_wall", [=]() -> int {
-            for (int i = Items.Size; i > 0; i--)
-                dev_console::add_log((dev_console::log_level_t)((i % 7) - 2), "str_fname", "str_func", i, "%d%x%d", i, i, i);
-            return 0;
-        });
+    /** A set bit marks the spill block of the same index as in use */
+    std::atomic<Uint64> spill_used[LOG_QUEUE_SPILL_COUNT / 64];
 
-        AutoScroll = true;
-        ScrollToBottom = false;
-    }
-    ~AppConsole()
+    /**
+     * Claim a free spill block
+     *
+     * @returns Index of the block, or -1 if every block is in use
+     */
+    int acquire_spill()
     {
-        ClearLog();
-        for (int i = 0; i < History.Size; i++)
-            free(History[i]);
+        for (int w = 0; w < LOG_QUEUE_SPILL_COUNT / 64; w++)
+        {
+            Uint64 used = spill_used[w].load(std::memory_order_relaxed);
+            for (int b = 0; b < 64; b++)
+            {
+                Uint64 bit = Uint64(1) << b;
+                if (used & bit)
+                    continue;
+                if (spill_used[w].compare_exchange_strong(used, used | bit, std::memory_order_acquire, std::memory_order_relaxed))
+                    return w * 64 + b;
+                /* used was reloaded by the failed exchange, so the scan continues with fresh bits */
+                b = -1;
+            }
+        }
+        return -1;
     }
 
-    // Portable helpers
-    static int Stricmp(const char* s1, const char* s2)
+    void release_spill(int index) { spill_used[index / 64].fetch_and(~(Uint64(1) << (index % 64)), std::memory_order_release); }
+
+    alignas(64) std::atomic<size_t> pos_enqueue;
+
+    alignas(64) std::atomic<size_t> pos_dequeue;
+
+    /**
+     * Attempt to push an item onto the queue
+     *
+     * Safe to call from any thread, this never allocates
+     *
+     * @param item Item to push, item.str is copied into the queue
+     * @param str_len Length of item.str, excluding the null terminator
+     *
+     * @returns true if the item was pushed, false if the queue or its spill blocks were full
+     */
+    bool try_push(const log_item_t& item, size_t str_len)
     {
-        int d;
-        while ((d = toupper(*s2) - toupper(*s1)) == 0 && *s1)
+        /* Text is cut to fit, payloads from log_format::capture() always fit as they are captured into VA_BUF_LEN bytes */
+        if (str_len >= LOG_QUEUE_SPILL_LEN && !item.fmt)
         {
-            s1++;
-            s2++;
+            str_len = LOG_QUEUE_SPILL_LEN - 1;
+            log_stats.truncated.fetch_add(1, std::memory_order_relaxed);
         }
-        return d;
-    }
-    static int Strnicmp(const char* s1, const char* s2, int n)
-    {
-        int d = 0;
-        while (n > 0 && (d = toupper(*s2) - toupper(*s1)) == 0 && *s1)
+        SDL_assert(str_len < LOG_QUEUE_SPILL_LEN);
+
+        int spill_index = -1;
+        if (str_len >= LOG_QUEUE_INLINE_LEN && (spill_index = acquire_spill()) < 0)
+            return false;
+
+        size_t pos = pos_enqueue.load(std::memory_order_relaxed);
+        for (;;)
         {
-            s1++;
-            s2++;
-            n--;
+            slot_t* slot = &slots[pos % LOG_QUEUE_SIZE];
+            size_t seq = slot->seq.load(std::memory_order_acquire) + pos % LOG_QUEUE_SIZE;
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0)
+            {
+                if (pos_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    slot->item = item;
+                    slot->str_len = str_len;
+                    slot->spill = spill_index + 1;
+                    slot->item.str = (spill_index < 0) ? slot->str_inline : spill[spill_index];
+                    memcpy(slot->item.str, item.str, str_len);
+                    slot->item.str[str_len] = '\0';
+                    slot->seq.store(pos + 1 - pos % LOG_QUEUE_SIZE, std::memory_order_release);
+                    return true;
+                }
+                log_stats.push_retries.fetch_add(1, std::memory_order_relaxed);
+            }
+            else if (diff < 0)
+            {
+                if (spill_index >= 0)
+                    release_spill(spill_index);
+                return false;
+            }
+            else
+                pos = pos_enqueue.load(std::memory_order_relaxed);
         }
-        return d;
-    }
-    static char* Strdup(const char* s)
-    {
-        IM_ASSERT(s);
-        size_t len = strlen(s) + 1;
-        void* buf = malloc(len);
-        IM_ASSERT(buf);
-        return (char*)memcpy(buf, (const void*)s, len);
-    }
-    static void Strtrim(char* s)
-    {
-        char* str_end = s + strlen(s);
-        while (str_end > s && str_end[-1] == ' ')
-            str_end--;
-        *str_end = 0;
     }
 
-    void ClearLog()
+    /**
+     * Get the item at the front of the queue without removing it
+     *
+     * WARNING: Only one thread may call this at a time (Callers must hold AppConsole::mutex_log)
+     *
+     * @returns Slot at the front of the queue, or NULL if the queue was empty
+     */
+    slot_t* front()
     {
-        std::lock_guard<std::mutex> lock(mutex_log);
-        for (int i = 0; i < Items.Size; i++)
-            free(Items[i].str);
-        Items.clear();
+        size_t pos = pos_dequeue.load(std::memory_order_relaxed);
+        slot_t* slot = &slots[pos % LOG_QUEUE_SIZE];
+        size_t seq = slot->seq.load(std::memory_order_acquire) + pos % LOG_QUEUE_SIZE;
+        return (seq == pos + 1) ? slot : NULL;
     }
 
-    void AddLogQuiet(const char* fmt, ...) IM_FMTARGS(2)
+    /**
+     * Release the slot returned by front()
+     *
+     * WARNING: Only one thread may call this at a time (Callers must hold AppConsole::mutex_log)
+     */
+    void pop()
     {
-        char buf[VA_BUF_LEN];
-        decode_variadic_to_buffer(buf, fmt);
+        size_t pos = pos_dequeue.load(std::memory_order_relaxed);
+        slot_t* slot = &slots[pos % LOG_QUEUE_SIZE];
+        if (slot->spill)
+            release_spill(slot->spill - 1);
+        slot->spill = 0;
+        slot->seq.store(pos + LOG_QUEUE_SIZE - pos % LOG_QUEUE_SIZE, std::memory_order_release);
+        pos_dequeue.store(pos + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Approximate number of items waiting in the queue
+     */
+    size_t size_approx() const { return pos_enqueue.load(std::memory_order_relaxed) - pos_dequeue.load(std::memory_order_relaxed); }
+};
+
+static log_queue_t log_queue;
+
+/** Set once the AppConsole instance has been constructed, zero initialized so that it can be read from static constructors */
+static std::atomic<bool> console_constructed;
+
+/**
+ * Match str against a glob pattern supporting '*' and '?'
+ */
+static bool glob_match(const char* pattern, const char* str)
+{
+    const char* star = NULL;
+    const char* star_str = NULL;
+    while (*str)
+    {
+        if (*pattern == '*')
+        {
+            star = pattern++;
+            star_str = str;
+        }
+        else if (*pattern == '?' || *pattern == *str)
+        {
+            pattern++;
+            str++;
+        }
+        else if (star)
+        {
+            pattern = star + 1;
+            str = ++star_str;
+        }
+        else
+            return false;
+    }
+    while (*pattern == '*')
+        pattern++;
+    return *pattern == '\0';
+}
+
+/**
+ * Registry of dc_log callsites and the glob rules applied to them by log_enable/log_disable
+ */
+struct log_callsite_registry_t
+{
+    struct rule_t
+    {
+        std::string glob;
+        bool enable;
+    };
+
+    std::mutex mutex;
+
+    /** Most recently registered callsite */
+    dev_console::log_callsite_t* head = NULL;
+
+    /** Rules in the order they were given, later rules take precedence */
+    std::vector<rule_t> rules;
+
+    static bool rule_matches(const rule_t& rule, const dev_console::log_callsite_t* site)
+    {
+        return glob_match(rule.glob.c_str(), site->fname) || glob_match(rule.glob.c_str(), site->func);
+    }
+
+    /**
+     * Calculate the state of a callsite from the rules and dev_console::log_level
+     *
+     * Callers must hold mutex
+     */
+    bool calc_locked(const dev_console::log_callsite_t* site)
+    {
+        for (size_t i = rules.size(); i > 0; i--)
+            if (rule_matches(rules[i - 1], site))
+                return rules[i - 1].enable;
+        return site->lvl <= dev_console::log_level.load(std::memory_order_relaxed);
+    }
+
+    bool add(dev_console::log_callsite_t* site, const char* func)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        signed char enabled = site->enabled.load(std::memory_order_relaxed);
+        if (enabled >= 0)
+            return enabled;
+
+        site->func = func;
+        enabled = calc_locked(site);
+        site->next = head;
+        head = site;
+        site->enabled.store(enabled, std::memory_order_relaxed);
+        return enabled;
+    }
+
+    /**
+     * Recalculate the state of all callsites
+     *
+     * @returns Number of callsites that changed state
+     */
+    int refresh()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        int changed = 0;
+        for (dev_console::log_callsite_t* it = head; it; it = it->next)
+        {
+            signed char enabled = calc_locked(it);
+            if (it->enabled.exchange(enabled, std::memory_order_relaxed) != enabled)
+                changed++;
+        }
+        return changed;
+    }
+
+    /**
+     * Add a rule and apply it
+     *
+     * @returns Number of callsites that changed state
+     */
+    int add_rule(const char* glob, bool enable)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            rule_t rule;
+            rule.glob = glob;
+            rule.enable = enable;
+            rules.push_back(rule);
+        }
+        return refresh();
+    }
+};
+
+/**
+ * Function local so that callsites reached from static constructors are registered into a constructed registry
+ */
+static log_callsite_registry_t& get_log_callsites()
+{
+    static log_callsite_registry_t registry;
+    return registry;
+}
+
+bool dev_console::register_callsite(dev_console::log_callsite_t* site, const char* func) { return get_log_callsites().add(site, func); }
+
+/**
+ * Fixed budget ring buffer of log items
+ *
+ * Item headers are kept in a circular buffer, and their strings are kept in a ring of fixed size chunks
+ *
+ * When either runs out of space the oldest items are evicted by advancing the start of the ring, nothing is freed or moved
+ */
+struct log_store_t
+{
+    /** Circular buffer of item headers */
+    log_item_t* items = NULL;
+    size_t items_cap = 0;
+
+    /** Absolute index of the oldest item */
+    Uint64 items_first = 0;
+
+    /** Absolute index one past the newest item */
+    Uint64 items_end = 0;
+
+    /** String arena, made up of num_chunks chunks each of size LOG_STORE_CHUNK_SIZE */
+    char* chunks = NULL;
+    size_t num_chunks = 0;
+
+    /** Absolute index of the chunk being written to */
+    Uint64 chunk_cur = 0;
+
+    /** Bytes used in the chunk being written to */
+    size_t chunk_used = 0;
+
+    /** Absolute index of the first item whose string was written to a given chunk, indexed by (chunk % num_chunks) */
+    Uint64* chunk_first_item = NULL;
+
+    /** Budget passed to init() */
+    size_t budget_bytes = 0;
+
+    /** Sum of num_lines of every item ever pushed, so that lines_before(size()) works */
+    Uint64 lines_total = 0;
+
+    /** Widest line_width of any item pushed since the last clear() */
+    float max_line_width = 0.0f;
+
+    /** Incremented by init(), absolute indices from before a change are meaningless */
+    Uint64 init_count = 0;
+
+    ~log_store_t() { release(); }
+
+    /**
+     * (Re)allocate the store to fit within budget bytes, this discards all items
+     */
+    void init(size_t budget)
+    {
+        release();
+
+        budget_bytes = budget;
+        items_cap = SDL_max(budget / (LOG_STORE_AVG_ITEM_SIZE + sizeof(log_item_t)), 64);
+        num_chunks = SDL_max((budget - SDL_min(budget, items_cap * sizeof(log_item_t))) / LOG_STORE_CHUNK_SIZE, 4);
+
+        items = (log_item_t*)malloc(items_cap * sizeof(log_item_t));
+        chunks = (char*)malloc(num_chunks * LOG_STORE_CHUNK_SIZE);
+        chunk_first_item = (Uint64*)malloc(num_chunks * sizeof(Uint64));
+        IM_ASSERT(items && chunks && chunk_first_item);
+
+        /* A zeroed chunk_first_item will never be past items_first so no special handling is needed for the first lap */
+        memset(chunk_first_item, 0, num_chunks * sizeof(Uint64));
+        items_first = 0;
+        items_end = 0;
+        chunk_cur = 0;
+        chunk_used = 0;
+        lines_total = 0;
+        max_line_width = 0.0f;
+        init_count++;
+    }
+
+    void release()
+    {
+        free(items);
+        free(chunks);
+        free(chunk_first_item);
+        items = NULL;
+        chunks = NULL;
+        chunk_first_item = NULL;
+        items_cap = 0;
+        num_chunks = 0;
+    }
+
+    /**
+     * Discard all items, O(1)
+     */
+    void clear()
+    {
+        items_first = items_end;
+        chunk_cur++;
+        chunk_used = 0;
+        if (num_chunks)
+            chunk_first_item[chunk_cur % num_chunks] = items_end;
+        max_line_width = 0.0f;
+    }
+
+    inline bool is_init() const { return items != NULL; }
+
+    inline size_t size() const { return items_end - items_first; }
+
+    /**
+     * Get item by index, where 0 is the oldest item
+     */
+    inline log_item_t& operator[](size_t i) { return items[(items_first + i) % items_cap]; }
+
+    /**
+     * Get item by absolute index, which must be in the range [items_first, items_end)
+     */
+    inline log_item_t& at_absolute(Uint64 i) { return items[i % items_cap]; }
+
+    /**
+     * Get the number of lines before item i, relative to the oldest item
+     *
+     * This is a prefix sum, so the lines in items [a, b) are lines_before(b) - lines_before(a)
+     *
+     * @param i Item index, where size() is valid and returns the total
+     */
+    inline Uint64 lines_before(size_t i)
+    {
+        Uint64 base = size() ? items[items_first % items_cap].lines_before : lines_total;
+        return (i < size() ? (*this)[i].lines_before : lines_total) - base;
+    }
+
+    /**
+     * Update the line index after num_lines or line_width of the newest item was changed in place
+     */
+    void update_back()
+    {
+        if (!size())
+            return;
+        log_item_t& l = (*this)[size() - 1];
+        lines_total = l.lines_before + l.num_lines;
+        max_line_width = SDL_max(max_line_width, l.line_width);
+    }
+
+    /**
+     * Push back an item, evicting the oldest items if necessary
+     *
+     * @param l Item to push back, l.text is copied into the store and l.str must point into l.text
+     * @param text_len Length of l.text, excluding the null terminator
+     */
+    void push_back(log_item_t l, size_t text_len)
+    {
+        text_len = SDL_min(text_len, LOG_STORE_CHUNK_SIZE - 1);
+
+        if (chunk_used + text_len + 1 > LOG_STORE_CHUNK_SIZE)
+        {
+            chunk_cur++;
+            chunk_used = 0;
+            chunk_first_item[chunk_cur % num_chunks] = items_end;
+
+            /* Evict items whose strings live in the chunk being reused */
+            Uint64 first_surviving = chunk_first_item[(chunk_cur + 1) % num_chunks];
+            if (items_first < first_surviving)
+                items_first = SDL_min(first_surviving, items_end);
+        }
+
+        if (size() == items_cap)
+            items_first++;
+
+        char* text = chunks + (chunk_cur % num_chunks) * LOG_STORE_CHUNK_SIZE + chunk_used;
+        memcpy(text, l.text, text_len);
+        text[text_len] = '\0';
+        chunk_used += text_len + 1;
+
+        l.str = text + SDL_min(size_t(l.str - l.text), text_len);
+        l.text = text;
+        l.lines_before = lines_total;
+        lines_total += l.num_lines;
+        max_line_width = SDL_max(max_line_width, l.line_width);
+        items[items_end % items_cap] = l;
+        items_end++;
+    }
+
+    /**
+     * Reallocate the store to fit within budget bytes, keeping as many of the newest items as possible
+     */
+    void resize(size_t budget)
+    {
+        /* Shallow copy so that old frees the previous allocations when it goes out of scope */
+        log_store_t old = *this;
+        items = NULL;
+        chunks = NULL;
+        chunk_first_item = NULL;
+
+        init(budget);
+
+        for (size_t i = 0; i < old.size(); i++)
+            push_back(old[i], strlen(old[i].text));
+    }
+
+    /**
+     * Approximate number of bytes used by the store
+     */
+    size_t mem_usage() const { return items_cap * sizeof(log_item_t) + num_chunks * (LOG_STORE_CHUNK_SIZE + sizeof(Uint64)); }
+};
+
+/**
+ * Absolute indices of the items in a log_store_t that pass a filter
+ *
+ * Entries are appended as items are scanned and dropped from the front as the store evicts items, so once built the
+ * index is only ever extended by the items that arrived since the last scan
+ */
+struct log_filter_index_t
+{
+    struct entry_t
+    {
+        /** Absolute index of the item in the store */
+        Uint64 item;
+
+        /** Sum of num_lines of every entry before this one */
+        Uint64 lines_before;
+    };
+
+    /** Separate from the console's filter so that a worker thread can use it while the user is typing */
+    ImGuiTextFilter filter;
+
+    std::vector<entry_t> entries;
+
+    /** Index of the oldest entry whose item has not been evicted */
+    size_t entries_first = 0;
+
+    /** Sum of num_lines of every entry ever added */
+    Uint64 lines_total = 0;
+
+    /** Widest line_width of any entry added */
+    float max_line_width = 0.0f;
+
+    /** Absolute index of the next item to test against filter */
+    Uint64 scan_end = 0;
+
+    /** log_store_t::init_count when scanning started */
+    Uint64 store_init_count = 0;
+
+    inline bool matches(const char* text) const { return strcmp(filter.InputBuf, text) == 0; }
+
+    /**
+     * Discard all entries and start over with a new filter
+     */
+    void reset(const char* text, const log_store_t& store)
+    {
+        if (text != filter.InputBuf)
+            snprintf(filter.InputBuf, IM_ARRAYSIZE(filter.InputBuf), "%s", text);
+        filter.Build();
+        entries.clear();
+        entries_first = 0;
+        lines_total = 0;
+        max_line_width = 0.0f;
+        scan_end = store.items_first;
+        store_init_count = store.init_count;
+    }
+
+    /**
+     * Drop entries whose items were evicted from the store
+     */
+    void prune(const log_store_t& store)
+    {
+        if (store_init_count != store.init_count)
+            reset(filter.InputBuf, store);
+
+        while (entries_first < entries.size() && entries[entries_first].item < store.items_first)
+            entries_first++;
+
+        if (entries_first > 1024 && entries_first > entries.size() / 2)
+        {
+            entries.erase(entries.begin(), entries.begin() + entries_first);
+            entries_first = 0;
+        }
+    }
+
+    /**
+     * Test the items in [scan_end, end) against filter
+     */
+    void extend(log_store_t& store, Uint64 end)
+    {
+        prune(store);
+        scan_end = SDL_max(scan_end, store.items_first);
+        end = SDL_min(end, store.items_end);
+
+        for (; scan_end < end; scan_end++)
+        {
+            const log_item_t& l = store.at_absolute(scan_end);
+            if (!filter.PassFilter(l.str))
+                continue;
+
+            entry_t e;
+            e.item = scan_end;
+            e.lines_before = lines_total;
+            entries.push_back(e);
+            lines_total += l.num_lines;
+            max_line_width = SDL_max(max_line_width, l.line_width);
+        }
+    }
+
+    inline size_t size() const { return entries.size() - entries_first; }
+
+    /**
+     * Get the absolute item index of entry i, where 0 is the oldest entry
+     */
+    inline Uint64 item(size_t i) const { return entries[entries_first + i].item; }
+
+    /**
+     * Find the entry for an absolute item index
+     *
+     * @returns Entry index, or SIZE_MAX if the item did not pass the filter
+     */
+    size_t find(Uint64 it) const
+    {
+        size_t lo = 0;
+        size_t hi = size();
+        while (lo < hi)
+        {
+            size_t mid = lo + (hi - lo) / 2;
+            if (item(mid) < it)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return (lo < size() && item(lo) == it) ? lo : SIZE_MAX;
+    }
+
+    /**
+     * Get the number of lines before entry i, relative to the oldest entry, where size() is valid and returns the total
+     */
+    inline Uint64 lines_before(size_t i) const
+    {
+        Uint64 base = size() ? entries[entries_first].lines_before : lines_total;
+        return (i < size() ? entries[entries_first + i].lines_before : lines_total) - base;
+    }
+};
+
+/**
+ * Query and results of the console search
+ *
+ * Results are absolute item indices in ascending order, appended by the search thread as it scans the store
+ */
+struct log_search_t
+{
+    struct query_t
+    {
+        std::string text;
+
+        /** Treat text as an ECMAScript regex instead of a substring, both ignore case */
+        bool regex = false;
+
+        /** Only match items at or below this level, INT_MAX to match every item */
+        int max_lvl = INT_MAX;
+
+        /** If not empty, only match items whose file name matches this glob */
+        std::string file_glob;
+
+        /** If not empty, only match items whose function name matches this glob */
+        std::string func_glob;
+
+        bool operator==(const query_t& o) const
+        {
+            return text == o.text && regex == o.regex && max_lvl == o.max_lvl && file_glob == o.file_glob && func_glob == o.func_glob;
+        }
+
+        bool operator!=(const query_t& o) const { return !(*this == o); }
+    };
+
+    query_t query;
+
+    /** Incremented by reset(), so that results for an older query can be recognized and discarded */
+    Uint64 generation = 0;
+
+    /** Reason the query could not be compiled, empty if it was compiled successfully */
+    std::string error;
+
+    std::vector<Uint64> matches;
+
+    /** Index of the oldest match whose item has not been evicted */
+    size_t matches_first = 0;
+
+    /** Absolute index of the next item to search */
+    Uint64 scan_end = 0;
+
+    /** log_store_t::init_count when searching started */
+    Uint64 store_init_count = 0;
+
+    inline bool active() const { return !query.text.empty(); }
+
+    inline bool done(const log_store_t& store) const { return scan_end >= store.items_end; }
+
+    void reset(const query_t& q, const log_store_t& store)
+    {
+        query = q;
+        generation++;
+        error.clear();
+        matches.clear();
+        matches_first = 0;
+        scan_end = store.items_first;
+        store_init_count = store.init_count;
+    }
+
+    /**
+     * Drop matches whose items were evicted from the store
+     */
+    void prune(const log_store_t& store)
+    {
+        if (store_init_count != store.init_count)
+            reset(query, store);
+
+        while (matches_first < matches.size() && matches[matches_first] < store.items_first)
+            matches_first++;
+
+        if (matches_first > 1024 && matches_first > matches.size() / 2)
+        {
+            matches.erase(matches.begin(), matches.begin() + matches_first);
+            matches_first = 0;
+        }
+    }
+
+    inline size_t size() const { return matches.size() - matches_first; }
+
+    /**
+     * Get the absolute item index of match i, where 0 is the oldest match
+     */
+    inline Uint64 match(size_t i) const { return matches[matches_first + i]; }
+
+    /**
+     * Get the index of the first match at or after the absolute item index it
+     */
+    size_t lower_bound(Uint64 it) const
+    {
+        size_t lo = 0;
+        size_t hi = size();
+        while (lo < hi)
+        {
+            size_t mid = lo + (hi - lo) / 2;
+            if (match(mid) < it)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+};
+
+/**
+ * Compiled form of log_search_t::query_t, this is only used by the search thread
+ */
+struct log_search_matcher_t
+{
+    log_search_t::query_t query;
+    std::regex re;
+
+    /** Lower case copy of query.text for text_scan::find_icase() */
+    std::string needle;
+
+    /**
+     * @param error Set to the reason q could not be compiled on failure
+     *
+     * @returns True on success
+     */
+    bool compile(const log_search_t::query_t& q, std::string& error)
+    {
+        query = q;
+        needle = q.text;
+        for (char& c : needle)
+            c = (c >= 'A' && c <= 'Z') ? char(c | 0x20) : c;
+
+        if (!q.regex)
+            return true;
+
+        try
+        {
+            re = std::regex(q.text, std::regex::ECMAScript | std::regex::icase | std::regex::optimize);
+        }
+        catch (const std::regex_error& e)
+        {
+            error = e.what();
+            return false;
+        }
+        return true;
+    }
+
+    bool matches(int lvl, const char* fname, const char* func, const char* str, size_t str_len) const
+    {
+        if (query.max_lvl != INT_MAX && (lvl < 0 || lvl > query.max_lvl))
+            return false;
+        if (!query.file_glob.empty() && !glob_match(query.file_glob.c_str(), fname))
+            return false;
+        if (!query.func_glob.empty() && !glob_match(query.func_glob.c_str(), func))
+            return false;
+        if (query.regex)
+            return std::regex_search(str, str + str_len, re);
+        return text_scan::find_icase(str, str_len, needle.data(), needle.size()) != NULL;
+    }
+};
+
+/**
+ * Copies of the newest items of each level, for the developer overlay
+ *
+ * This has its own mutex so that the overlay never has to lock the main store, and a query walks only the items it returns
+ */
+struct log_recent_t
+{
+    struct entry_t
+    {
+        /** Copy of the item, where text points to text_buf and str is not valid */
+        log_item_t item;
+
+        /** Order of the entry across all levels */
+        Uint64 seq;
+
+        /** Set if text_buf holds less than the text of the item, item is then measured from text_buf instead */
+        bool truncated;
+
+        char text_buf[LOG_RECENT_TEXT_LEN];
+    };
+
+    /** Ring of the newest items of a single level */
+    struct ring_t
+    {
+        entry_t entries[LOG_RECENT_ITEMS];
+
+        /** Number of entries ever pushed */
+        Uint64 end = 0;
+
+        inline entry_t& from_back(Uint64 i) { return entries[(end - 1 - i) % LOG_RECENT_ITEMS]; }
+
+        inline Uint64 size() const { return SDL_min(end, Uint64(LOG_RECENT_ITEMS)); }
+    };
+
+    std::mutex mutex;
+
+    ring_t rings[dev_console::LEVEL_TRACE + 1];
+
+    Uint64 seq = 0;
+
+    /**
+     * Measure a truncated copy, so that the overlay does not budget lines for text that was cut off
+     */
+    static void measure(log_item_t& item)
+    {
+        char buf[LOG_RECENT_TEXT_LEN + 64];
+        const char* text = item.display_text(buf, IM_ARRAYSIZE(buf));
+        text_scan::metrics_t metrics = text_scan::measure(text, strlen(text));
+        item.line_width = metrics.max_line_len * dev_console::add_log_font_width;
+        item.width_key = 0;
+        item.num_lines = metrics.num_lines;
+    }
+
+    /**
+     * Copy an item into the ring of its level
+     */
+    void push(const log_item_t& l)
+    {
+        if (l.lvl < 0 || l.lvl > dev_console::LEVEL_TRACE)
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        ring_t& ring = rings[l.lvl];
+        entry_t& e = ring.entries[ring.end % LOG_RECENT_ITEMS];
+        ring.end++;
+
+        e.item = l;
+        e.item.str = NULL;
+        e.item.text = e.text_buf;
+        e.seq = seq++;
+
+        size_t text_len = strlen(l.text);
+        size_t len = SDL_min(text_len, sizeof(e.text_buf) - 1);
+        memcpy(e.text_buf, l.text, len);
+        e.text_buf[len] = '\0';
+
+        e.truncated = len < text_len;
+        if (e.truncated)
+            measure(e.item);
+    }
+
+    /**
+     * Update the copy of an item after it was changed in place, l must be the last item given to push()
+     */
+    void update_back(const log_item_t& l)
+    {
+        if (l.lvl < 0 || l.lvl > dev_console::LEVEL_TRACE)
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        ring_t& ring = rings[l.lvl];
+        if (!ring.end)
+            return;
+        entry_t& e = ring.from_back(0);
+        log_item_t& item = e.item;
+        item.time = l.time;
+        item.repeat = l.repeat;
+        item.suppressed = l.suppressed;
+        if (e.truncated)
+        {
+            measure(item);
+            return;
+        }
+        item.num_lines = l.num_lines;
+        item.line_width = l.line_width;
+        item.width_key = l.width_key;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (ring_t& ring : rings)
+            ring.end = 0;
+    }
+
+    /**
+     * Walk the items at or below max_lvl from newest to oldest, merging the rings of each level by seq
+     *
+     * Callers must hold mutex
+     *
+     * @param fn Called with each item until it returns false
+     */
+    template <typename func_t> void walk_locked(dev_console::log_level_t max_lvl, func_t fn)
+    {
+        int max_ring = SDL_clamp(int(max_lvl), -1, int(dev_console::LEVEL_TRACE));
+        Uint64 pos[dev_console::LEVEL_TRACE + 1] = {};
+
+        while (true)
+        {
+            int best = -1;
+            for (int i = 0; i <= max_ring; i++)
+            {
+                if (pos[i] >= rings[i].size())
+                    continue;
+                if (best < 0 || rings[i].from_back(pos[i]).seq > rings[best].from_back(pos[best]).seq)
+                    best = i;
+            }
+
+            if (best < 0 || !fn(rings[best].from_back(pos[best]++).item))
+                return;
+        }
+    }
+};
+
+/**
+ * Data waiting to be written to stdout or the log file, kept in fixed size blocks so that a flush is a single writev() call
+ *
+ * Data is appended by AppConsole::drain_log_locked() and written by the sink thread or AppConsole::flush_log()
+ */
+struct log_sink_t
+{
+    struct block_t
+    {
+        size_t used;
+        char data[LOG_SINK_BLOCK_SIZE];
+    };
+
+    /** Blocks waiting to be written, guarded by AppConsole::mutex_log */
+    std::vector<block_t*> pending;
+
+    /** Blocks available for reuse, guarded by AppConsole::mutex_log */
+    std::vector<block_t*> spare;
+
+    ~log_sink_t()
+    {
+        for (block_t* b : pending)
+            free(b);
+        for (block_t* b : spare)
+            free(b);
+    }
+
+    /** Bytes discarded because the sink fell too far behind */
+    std::atomic<Uint64> dropped { 0 };
+
+    /**
+     * Append data, either all of it is appended or none of it is
+     *
+     * Callers must hold AppConsole::mutex_log
+     *
+     * @param no_split Start a new block instead of splitting the data across blocks (If it fits in one block)
+     *
+     * @returns false if there was not enough room
+     */
+    bool append_raw(const char* data, size_t len, bool no_split = false)
+    {
+        size_t tail_room = pending.size() ? LOG_SINK_BLOCK_SIZE - pending.back()->used : 0;
+        if (no_split && len > tail_room && len <= LOG_SINK_BLOCK_SIZE)
+            tail_room = 0;
+
+        size_t room = (LOG_SINK_MAX_BLOCKS - pending.size()) * LOG_SINK_BLOCK_SIZE + tail_room;
+        if (len > room)
+        {
+            dropped.fetch_add(len, std::memory_order_relaxed);
+            return false;
+        }
+
+        while (len)
+        {
+            block_t* b = pending.size() ? pending.back() : NULL;
+            if (!b || b->used == LOG_SINK_BLOCK_SIZE || !tail_room)
+            {
+                if (spare.size())
+                {
+                    b = spare.back();
+                    spare.pop_back();
+                }
+                else
+                    b = (block_t*)malloc(sizeof(block_t));
+                b->used = 0;
+                pending.push_back(b);
+                tail_room = LOG_SINK_BLOCK_SIZE;
+            }
+
+            size_t n = SDL_min(len, LOG_SINK_BLOCK_SIZE - b->used);
+            memcpy(b->data + b->used, data, n);
+            b->used += n;
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    /**
+     * Append a line of text, a newline is added if it is missing
+     *
+     * Callers must hold AppConsole::mutex_log
+     */
+    void append(const char* str, size_t len)
+    {
+        if (append_raw(str, len) && (!len || str[len - 1] != '\n'))
+            append_raw("\n", 1);
+    }
+
+    /**
+     * Write blocks to stdout
+     *
+     * This does not touch pending or spare and so does not need AppConsole::mutex_log
+     */
+    static void write(const std::vector<block_t*>& blocks)
+    {
+        if (!blocks.size())
+            return;
+
+        /* Anything printed directly with stdio must come out first */
+        fflush(stdout);
+
+#ifdef SDL_PLATFORM_WINDOWS
+        for (block_t* b : blocks)
+            fwrite(b->data, 1, b->used, stdout);
+        fflush(stdout);
+#else
+        struct iovec iov[LOG_SINK_MAX_BLOCKS];
+        int iov_cnt = 0;
+        for (block_t* b : blocks)
+        {
+            iov[iov_cnt].iov_base = b->data;
+            iov[iov_cnt].iov_len = b->used;
+            iov_cnt++;
+        }
+
+        struct iovec* it = iov;
+        while (iov_cnt)
+        {
+            ssize_t written = writev(STDOUT_FILENO, it, iov_cnt);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written < 0)
+                return;
+            log_stats.stdout_writes.fetch_add(1, std::memory_order_relaxed);
+            while (iov_cnt && size_t(written) >= it->iov_len)
+            {
+                written -= it->iov_len;
+                it++;
+                iov_cnt--;
+            }
+            if (iov_cnt)
+            {
+                it->iov_base = (char*)it->iov_base + written;
+                it->iov_len -= written;
+            }
+        }
+#endif
+    }
+};
+
+static convar_int_t console_log_flush_ms("console_log_flush_ms", 10, 1, 1000, "Interval between writes of log messages to stdout (Milliseconds)");
+
+static convar_int_t console_log_collapse("console_log_collapse", 1, 0, 1,
+    "Collapse consecutive identical log messages from the same callsite into a single item with a repeat count", CONVAR_FLAG_INT_IS_BOOL);
+
+static convar_int_t console_log_file("console_log_file", 0, 0, 1,
+    "Write console log records to binary files in the directory logs/ of the write dir (See: log_dump)", CONVAR_FLAG_INT_IS_BOOL | CONVAR_FLAG_SAVE);
+static convar_int_t console_log_file_max_kb(
+    "console_log_file_max_kb", 1024, 16, 1024 * 1024, "Size at which a new console log file is started (KiB)", CONVAR_FLAG_SAVE);
+static convar_int_t console_log_file_count("console_log_file_count", 5, 1, 1000, "Number of console log files to keep", CONVAR_FLAG_SAVE);
+
+static convar_int_t console_log_recorder_kb("console_log_recorder_kb", 0, 0, 64 * 1024,
+    "Size of the crash surviving flight recorder in the write dir, 0 to disable (KiB) (See: log_recover) (Applied at startup)", CONVAR_FLAG_SAVE);
+
+static convar_int_t console_log_budget_kb("console_log_budget_kb", 8192, 256, 1024 * 1024, "Memory budget for console log history (KiB)");
+
+static convar_int_t con_test_generation_cvr(
+    "_con_test_generation", 0, 0, 1 << 30, "Set by _con_test_convar_generations", CONVAR_FLAG_HIDDEN | CONVAR_FLAG_DEV_ONLY);
+static convar_int_t con_test_generation_deferred_cvr("_con_test_generation_deferred", 0, 0, 1 << 30, "Set by _con_test_convar_generations",
+    CONVAR_FLAG_HIDDEN | CONVAR_FLAG_DEV_ONLY | CONVAR_FLAG_DEFERRED_CALLBACK);
+static convar_string_t con_test_publish_cvr("_con_test_publish", "", "Set by _con_test_convar_publish", CONVAR_FLAG_HIDDEN | CONVAR_FLAG_DEV_ONLY);
+
+static void stop_log_sink();
+
+/**
+ * Map key for a C string name and its convar_t::hash_name(), so that lookups do not need to construct a std::string,
+ * and a hash computed once can be used for both commands_map and convar_t::get_convar()
+ */
+struct hashed_name_t
+{
+    const char* name;
+    Uint32 hash;
+
+    hashed_name_t(const char* _name)
+        : name(_name)
+        , hash(convar_t::hash_name(_name))
+    {
+    }
+
+    hashed_name_t(const char* _name, Uint32 _hash)
+        : name(_name)
+        , hash(_hash)
+    {
+    }
+
+    bool operator==(const hashed_name_t& other) const { return hash == other.hash && strcmp(name, other.name) == 0; }
+
+    struct hasher_t
+    {
+        size_t operator()(const hashed_name_t& key) const { return key.hash; }
+    };
+};
+
+/**
+ * Case insensitive sorted index of command and convar names, for tab completion and help
+ *
+ * Convars are picked up from convar_t::get_convar_list() as they are registered, and their flags are checked when
+ * querying as the result of CONVAR_FLAG_DEV_ONLY depends on the dev convar
+ */
+struct name_index_t
+{
+    struct entry_t
+    {
+        /** Lower case copy of name, the sort key */
+        std::string key;
+        const char* name;
+
+        /** NULL for commands */
+        convar_t* cvr;
+
+        bool operator<(const entry_t& other) const { return key < other.key; }
+    };
+
+    /**
+     * Add a command, name is not copied
+     */
+    void add_command(const char* name)
+    {
+        entry_t e = { lower(name, strlen(name)), name, NULL };
+        entries.insert(std::upper_bound(entries.begin(), entries.end(), e), std::move(e));
+    }
+
+    /**
+     * Index any convars registered since the last call
+     */
+    void sync_convars()
+    {
+        std::vector<convar_t*>* list = convar_t::get_convar_list();
+        if (convars_indexed == list->size())
+            return;
+
+        size_t old_size = entries.size();
+        for (; convars_indexed < list->size(); convars_indexed++)
+        {
+            convar_t* cvr = list->at(convars_indexed);
+            entries.push_back({ lower(cvr->get_name(), strlen(cvr->get_name())), cvr->get_name(), cvr });
+        }
+        std::sort(entries.begin() + old_size, entries.end());
+        std::inplace_merge(entries.begin(), entries.begin() + old_size, entries.end());
+    }
+
+    /**
+     * Whether an entry should be listed
+     *
+     * @param underscore List commands that start with an underscore
+     */
+    static bool visible(const entry_t& e, bool underscore)
+    {
+        if (!e.cvr)
+            return underscore || e.name[0] != '_';
+        CONVAR_FLAGS flags = e.cvr->get_convar_flags();
+        return !(flags & CONVAR_FLAG_HIDDEN) && !(!convar_t::dev() && (flags & CONVAR_FLAG_DEV_ONLY));
+    }
+
+    /**
+     * Call fn for every visible entry whose name starts with prefix (Ignoring case) in sorted order
+     *
+     * Commands that start with an underscore are only visible if prefix does as well
+     */
+    template <typename F> void for_each_prefix(const char* prefix, size_t len, F fn)
+    {
+        sync_convars();
+        std::string key = lower(prefix, len);
+        bool underscore = len && prefix[0] == '_';
+        auto it = std::lower_bound(entries.begin(), entries.end(), key, [](const entry_t& e, const std::string& k) { return e.key < k; });
+        for (; it != entries.end() && it->key.compare(0, len, key) == 0; ++it)
+            if (visible(*it, underscore))
+                fn(*it);
+    }
+
+    /**
+     * Score how well pattern fuzzy matches key, favoring consecutive characters and matches at the start of words
+     *
+     * @param pattern Lower case pattern
+     *
+     * @returns -1 if pattern is not a subsequence of key
+     */
+    static int fuzzy_score(const std::string& key, const char* pattern, size_t len)
+    {
+        int score = 0;
+        size_t p = 0;
+        size_t last_match = SIZE_MAX;
+        for (size_t i = 0; i < key.length() && p < len; i++)
+        {
+            if (key[i] != pattern[p])
+                continue;
+            score += 1;
+            if (last_match != SIZE_MAX && last_match + 1 == i)
+                score += 4;
+            if (i == 0 || key[i - 1] == '_')
+                score += 3;
+            last_match = i;
+            p++;
+        }
+        if (p < len)
+            return -1;
+        return score * 16 - int(SDL_min(key.length() - len, size_t(15)));
+    }
+
+    /**
+     * Get up to max_results visible entries that fuzzy match pattern, best first
+     */
+    std::vector<const entry_t*> fuzzy_find(const char* pattern, size_t len, size_t max_results)
+    {
+        sync_convars();
+        std::string key = lower(pattern, len);
+        bool underscore = len && pattern[0] == '_';
+
+        std::vector<std::pair<int, const entry_t*>> scored;
+        for (const entry_t& e : entries)
+        {
+            int score = fuzzy_score(e.key, key.c_str(), key.length());
+            if (score >= 0 && visible(e, underscore))
+                scored.push_back(std::make_pair(-score, &e));
+        }
+
+        size_t num = SDL_min(scored.size(), max_results);
+        std::partial_sort(scored.begin(), scored.begin() + num, scored.end());
+
+        std::vector<const entry_t*> out;
+        for (size_t i = 0; i < num; i++)
+            out.push_back(scored[i].second);
+        return out;
+    }
+
+private:
+    static std::string lower(const char* s, size_t len)
+    {
+        std::string out(s, len);
+        for (char& c : out)
+            c = tolower(c);
+        return out;
+    }
+
+    std::vector<entry_t> entries;
+
+    /** Number of convars in convar_t::get_convar_list() that have been added to entries */
+    size_t convars_indexed = 0;
+};
+
+/**
+ * A console script that was tokenized once for the exec command, and can be replayed without being parsed again
+ */
+struct console_script_t
+{
+    struct command_t
+    {
+        /** Index of argv[0] in argv, or -1 for a built in command that is run from its source line */
+        int argv_first;
+        int argc;
+
+        /** Position of the command in source, for error messages and built in commands */
+        size_t raw_pos;
+        size_t raw_len;
+
+        /** convar_t::hash_name() of argv[0] */
+        Uint32 name_hash;
+    };
+
+    /** Text of the script, with every line ending replaced by a null terminator */
+    std::string source;
+
+    /** Arguments of every command, each one null terminated */
+    std::string strings;
+
+    /** argv arrays of every command, each one NULL terminated */
+    std::vector<const char*> argv;
+
+    std::vector<command_t> commands;
+
+    /** PHYSFS_Stat::modtime and PHYSFS_Stat::filesize of the script when it was read */
+    Sint64 modtime;
+    Sint64 filesize;
+};
+
+// Demonstrate creating a simple console window, with scrolling, filtering, completion and history.
+// For the console example, we are using a more C++ like approach of declaring a class to hold both data and functions.
+struct AppConsole
+{
+#define MAX_INPUT_LENGTH 1024
+    // #define DEBUG_EXEC_MAPPED_COMMAND
+    char InputBuf[MAX_INPUT_LENGTH];
+    log_store_t Items;
+    name_index_t name_index;
+    ImVector<char*> History;
+    int HistoryPos; // -1: new line, 0..History.Size-1 browsing history.
+    ImGuiTextFilter Filter;
+    log_filter_index_t filter_index;
+    log_recent_t recent;
+    bool AutoScroll;
+    bool ScrollToBottom;
+    bool forceReclaimFocus;
+    bool console_fullscreen_bool;
+    std::mutex mutex_log;
+
+    std::unordered_map<hashed_name_t, std::function<int(const int, const char**)>, hashed_name_t::hasher_t> commands_map;
+
+    AppConsole()
+    {
+        forceReclaimFocus = false;
+        ClearLog();
+        memset(InputBuf, 0, sizeof(InputBuf));
+        HistoryPos = -1;
+
+        name_index.add_command("help");
+        name_index.add_command("history");
+        name_index.add_command("echo");
+
+#ifdef DEBUG_EXEC_MAPPED_COMMAND
+        AddCommand("c", [=](const int argc, const char** argv) -> int {
+            for (int i = 0; i < argc; i++)
+                AddLog("DEBUG_EXEC_MAPPED_COMMAND: argv[%d]=\"%s\"", i, argv[i]);
+            return 0;
+        });
+#endif
+
+        AddCommand("clear", [=]() -> int {
+            ClearLog();
+            return 0;
+        });
+        AddCommand("exec", [=](const int argc, const char* argv[]) -> int {
+            if (argc != 2)
+            {
+                AddLog("Usage: %s <script path>", argv[0]);
+                return 1;
+            }
+
+            if (script_depth >= CONSOLE_EXEC_MAX_DEPTH)
+            {
+                dc_log_error("Scripts are nested more than %d deep, not running \"%s\"", CONSOLE_EXEC_MAX_DEPTH, argv[1]);
+                return 1;
+            }
+
+            std::shared_ptr<console_script_t> script = GetScript(argv[1]);
+            if (!script)
+            {
+                dc_log_error("Unable to read script \"%s\": %s", argv[1], PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+                return 1;
+            }
+
+            script_depth++;
+            ExecScript(*script);
+            script_depth--;
+            return 0;
+        });
+        AddCommand("log_stats", [=]() -> int {
+            AddLog("Log items enqueued:            %llu", (unsigned long long)log_stats.enqueued.load());
+            AddLog("Log items drained:             %llu", (unsigned long long)log_stats.drained.load());
+            AddLog("Log items pending:             %llu", (unsigned long long)log_queue.size_approx());
+            AddLog("Largest drain batch:           %llu", (unsigned long long)log_stats.drained_max_batch.load());
+            AddLog("Producer slot retries:         %llu", (unsigned long long)log_stats.push_retries.load());
+            AddLog("Producer queue full events:    %llu", (unsigned long long)log_stats.queue_full.load());
+            AddLog("Log items truncated:           %llu", (unsigned long long)log_stats.truncated.load());
+            AddLog("Log mutex contention events:   %llu", (unsigned long long)log_stats.lock_contended.load());
+            AddLog("Log items collapsed:           %llu", (unsigned long long)log_stats.collapsed.load());
+            AddLog("Log items rate limited:        %llu", (unsigned long long)log_stats.rate_limited.load());
+            AddLog("Stdout writes:                 %llu", (unsigned long long)log_stats.stdout_writes.load());
+            AddLog("Stdout bytes dropped:          %llu", (unsigned long long)sink.dropped.load());
+            AddLog("Log file bytes dropped:        %llu", (unsigned long long)file_sink.dropped.load());
+            std::unique_lock<std::mutex> lock = lock_log();
+            size_t store_size = Items.size();
+            size_t store_cap = Items.items_cap;
+            size_t store_mem = Items.mem_usage();
+            lock.unlock();
+            AddLog("Log store: %zu/%zu items, %zu KiB", store_size, store_cap, store_mem / 1024);
+            return 0;
+        });
+        AddCommand("log_export", [=](const int argc, const char** argv) -> int {
+            if (argc < 2)
+            {
+                AddLog("Usage: %s <path | --clipboard> [max level, 0: Fatal .. 4: Trace]", argv[0]);
+                AddLog("Exports the console log through the current console filter from a background thread");
+                return 1;
+            }
+
+            int max_lvl = INT_MAX;
+            if (argc > 2)
+                max_lvl = SDL_clamp(atoi(argv[2]), int(dev_console::LEVEL_FATAL), int(dev_console::LEVEL_TRACE));
+
+            const char* path = strcmp(argv[1], "--clipboard") == 0 ? NULL : argv[1];
+            return start_export(path, Filter.InputBuf, max_lvl) ? 0 : 1;
+        });
+        AddCommand("log_enable", [=](const int argc, const char** argv) -> int {
+            if (argc < 2)
+            {
+                AddLog("Usage: %s <glob> [glob...]", argv[0]);
+                return 1;
+            }
+            for (int i = 1; i < argc; i++)
+                AddLog("Enabled %d callsites matching \"%s\"", get_log_callsites().add_rule(argv[i], true), argv[i]);
+            return 0;
+        });
+        AddCommand("log_disable", [=](const int argc, const char** argv) -> int {
+            if (argc < 2)
+            {
+                AddLog("Usage: %s <glob> [glob...]", argv[0]);
+                return 1;
+            }
+            for (int i = 1; i < argc; i++)
+                AddLog("Disabled %d callsites matching \"%s\"", get_log_callsites().add_rule(argv[i], false), argv[i]);
+            return 0;
+        });
+        AddCommand("log_reset", [=]() -> int {
+            log_callsite_registry_t& callsites = get_log_callsites();
+            {
+                std::lock_guard<std::mutex> lock(callsites.mutex);
+                callsites.rules.clear();
+            }
+            AddLog("Reset %d callsites to log_level", callsites.refresh());
+            return 0;
+        });
+        AddCommand("log_callsites", [=](const int argc, const char** argv) -> int {
+            const char* glob = argc > 1 ? argv[1] : "*";
+            std::vector<const dev_console::log_callsite_t*> sites;
+            log_callsite_registry_t& callsites = get_log_callsites();
+            {
+                std::lock_guard<std::mutex> lock(callsites.mutex);
+                for (const dev_console::log_callsite_t* it = callsites.head; it; it = it->next)
+                    if (glob_match(glob, it->fname) || glob_match(glob, it->func))
+                        sites.push_back(it);
+            }
+            for (const dev_console::log_callsite_t* it : sites)
+            {
+                unsigned int suppressed = it->rate_suppressed.load(std::memory_order_relaxed);
+                if (suppressed)
+                    AddLog("[%s] %s:%s:%d (%u suppressed)", it->enabled.load(std::memory_order_relaxed) ? "on " : "off", it->fname, it->func, it->line,
+                        suppressed);
+                else
+                    AddLog("[%s] %s:%s:%d", it->enabled.load(std::memory_order_relaxed) ? "on " : "off", it->fname, it->func, it->line);
+            }
+            AddLog("%zu registered callsites matching \"%s\"", sites.size(), glob);
+            return 0;
+        });
+        AddCommand("log_dump", [=](const int argc, const char** argv) -> int {
+            if (argc < 2)
+            {
+                std::vector<std::string> files = log_file::list_files();
+                for (const std::string& path : files)
+                {
+                    PHYSFS_Stat stat;
+                    if (!PHYSFS_stat(path.c_str(), &stat))
+                        stat.filesize = -1;
+                    AddLog("%s (%lld bytes)", path.c_str(), (long long)stat.filesize);
+                }
+                AddLog("%zu log files, usage: %s <log file> [output text file]", files.size(), argv[0]);
+                return 0;
+            }
+
+            PHYSFS_File* out = NULL;
+            if (argc > 2 && !(out = PHYSFS_openWrite(argv[2])))
+            {
+                dc_log_error("Unable to open \"%s\": %s", argv[2], PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+                return 1;
+            }
+
+            size_t num_msgs = 0;
+            bool ok = log_file::read(argv[1], [&](const log_file::message_t& msg) {
+                log_item_t l;
+                l.str = (char*)msg.text;
+                l.lvl = (dev_console::log_level_t)msg.lvl;
+                l.str_fname = msg.fname;
+                l.str_func = msg.func;
+                l.line = msg.line;
+                l.repeat = msg.repeat;
+                l.suppressed = msg.suppressed;
+
+                char buf[VA_BUF_LEN];
+                l.format_str(buf, IM_ARRAYSIZE(buf));
+                dump_line(out, msg.time, buf);
+                num_msgs++;
+            });
+
+            if (out)
+                PHYSFS_close(out);
+
+            if (!ok)
+            {
+                dc_log_error("\"%s\" is not a readable log file", argv[1]);
+                return 1;
+            }
+
+            AddLog("Read %zu messages from \"%s\"", num_msgs, argv[1]);
+            return 0;
+        });
+        AddCommand("log_recover", [=](const int argc, const char** argv) -> int {
+            const char* path = (argc > 1) ? argv[1] : LOG_RECORDER_PREV_PATH;
+
+            PHYSFS_File* out = NULL;
+            if (argc > 2 && !(out = PHYSFS_openWrite(argv[2])))
+            {
+                dc_log_error("Unable to open \"%s\": %s", argv[2], PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+                return 1;
+            }
+
+            size_t num_msgs = 0;
+            bool ok = log_recorder::read(path, [&](const log_recorder::message_t& msg) {
+                log_item_t l;
+                l.text = (char*)msg.text;
+                l.repeat = msg.repeat;
+                l.suppressed = 0;
+
+                char buf[VA_BUF_LEN];
+                dump_line(out, msg.time, l.display_text(buf, IM_ARRAYSIZE(buf)));
+                num_msgs++;
+            });
+
+            if (out)
+                PHYSFS_close(out);
+
+            if (!ok)
+            {
+                dc_log_error("\"%s\" is not a readable flight recorder file", path);
+                AddLog("Usage: %s [flight recorder file (Default: %s)] [output text file]", argv[0], LOG_RECORDER_PREV_PATH);
+                return 1;
+            }
+
+            AddLog("Recovered %zu messages from \"%s\"", num_msgs, path);
+            return 0;
+        });
+        AddCommand("_crash_nullptr_dereference", [=]() -> int {
+            char* a = nullptr;
+            a[0] = 0;
+
+            return 1;
+        });
+        AddCommand("_crash_stackoverflow", [=]() -> int {
+            struct c
+            {
+                int b = 1;
+                void crash()
+                {
+                    if (b != 0)
+                    {
+                        crash();
+                    }
+                }
+            };
+            c b;
+            b.crash();
+
+            return 1;
+        });
+
+        AddCommand("_crash_local_convar", [=]() -> int {
+            convar_int_t cl_crash_local_convar("cl_crash_local_convar", 0, 0, 0, 0);
+            return 1;
+        });
+
+        AddCommand("_con_test_returncode", [=](const int argc, const char* argv[]) -> int {
+            if (argc > 1)
+            {
+                return atoi(argv[1]);
+            }
+            return 1;
+        });
+
+        AddCommand("_con_test_log_fatal", [=](const int argc, const char* argv[]) -> int {
+            dc_log_fatal("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
+            return 0;
+        });
+
+        AddCommand("_con_test_log_error", [=](const int argc, const char* argv[]) -> int {
+            dc_log_error("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
+            return 0;
+        });
+
+        AddCommand("_con_test_log_warn", [=](const int argc, const char* argv[]) -> int {
+            dc_log_warn("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
+            return 0;
+        });
+
+        AddCommand("_con_test_log_info", [=](const int argc, const char* argv[]) -> int {
+            dc_log("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
+            return 0;
+        });
+
+        AddCommand("_con_test_log_trace", [=](const int argc, const char* argv[]) -> int {
+            dc_log_trace("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
+            return 0;
+        });
+
+        AddCommand("_con_test_log_internal", [=](const int argc, const char* argv[]) -> int {
+            dc_log_internal("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
+            return 0;
+        });
+
+        AddCommand("_con_test_log_all", [=](const int argc, const char* argv[]) -> int {
+            dc_log_fatal("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
+            dc_log_error("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
+            dc_log_warn("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
+            dc_log("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
+            dc_log_trace("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
+            dc_log_internal("argc = %d, argv[0] = \"%s\"", argc, argv[0]);
+            return 0;
+        });
+
+        AddCommand("_con_test_log_multiline_internal", [=](const int argc, const char* argv[]) -> int {
+            dc_log_internal("argc = %d, argv[0] = \"%s\"\nline 2\nline 3\nline 4", argc, argv[0]);
+            return 0;
+        });
+
+        AddCommand("_con_test_log_multiline_warn", [=](const int argc, const char* argv[]) -> int {
+            dc_log_warn("argc = %d, argv[0] = \"%s\"\nline 2\nline 3\nline 4", argc, argv[0]);
+            return 0;
+        });
+
+        AddCommand("_con_test_log_multiline_warn_trailing", [=](const int argc, const char* argv[]) -> int {
+            dc_log_warn("argc = %d, argv[0] = \"%s\"\nline 2\nline 3\nline 4\n\n", argc, argv[0]);
+            return 0;
+        });
+
+        AddCommand("_con_test_log_multiline_error_mult", [=]() -> int {
+            char buf[64];
+            for (int i = 0; i < IM_ARRAYSIZE(buf); i++)
+                buf[i] = (i % 2 == 0) ? 'X' : '\n';
+            buf[IM_ARRAYSIZE(buf) - 1] = '\n';
+            for (int i = 1; i < IM_ARRAYSIZE(buf); i += 2)
+            {
+                dc_log_error("Num newlines: %d%.*send", i, i, buf);
+            }
+            return 0;
+        });
+
+        AddCommand("_con_test_log_wall", [=]() -> int {
+            std::unique_lock<std::mutex> lock = lock_log();
+            int num_items = Items.size();
+            lock.unlock();
+            for (int i = num_items; i > 0; i--)
+                dev_console::add_log((dev_console::log_level_t)((i % 7) - 2), "str_fname", "str_func", i, "%d%x%d", i, i, i);
+            return 0;
+        });
+
+        AddCommand("_con_bench_text_measure", [=](const int argc, const char* argv[]) -> int {
+            int iterations = (argc > 1) ? SDL_max(atoi(argv[1]), 1) : 100000;
+
+            /* The per line SDL_utf8strnlen() loop that text_scan::measure() replaced */
+            auto measure_reference = [](const char* text, text_scan::metrics_t& m) {
+                m.num_lines = 0;
+                m.max_line_len = 0;
+                const char* lstart = text;
+                const char* i = text;
+                for (; *i != '\0'; i++)
+                {
+                    if (*i != '\n')
+                        continue;
+                    m.max_line_len = SDL_max(m.max_line_len, SDL_utf8strnlen(lstart, i - lstart));
+                    lstart = i + 1;
+                    m.num_lines++;
+                }
+                m.max_line_len = SDL_max(m.max_line_len, SDL_utf8strnlen(lstart, i - lstart));
+                if (lstart != i)
+                    m.num_lines++;
+                m.num_lines = SDL_max(m.num_lines, size_t(1));
+            };
+
+            const char* samples[] = {
+                "[console.cpp:operator():1234]: Short message",
+                "[tetra_sdl_gpu.cpp:init:176][warn]: A longer message with some UTF-8 \xc3\xa9\xc3\xa8\xe2\x82\xac in it that is about one hundred bytes",
+                "[console.cpp:operator():1234]: argc = 1\nline 2\nline 3\nline 4\nline 5 is a bit longer than the others\n",
+            };
+
+            for (const char* sample : samples)
+            {
+                size_t len = strlen(sample);
+                size_t checksum = 0;
+
+                Uint64 start = SDL_GetTicksNS();
+                for (int i = 0; i < iterations; i++)
+                {
+                    text_scan::metrics_t m;
+                    measure_reference(sample, m);
+                    checksum += m.num_lines + m.max_line_len;
+                }
+                Uint64 time_reference = SDL_GetTicksNS() - start;
+
+                start = SDL_GetTicksNS();
+                for (int i = 0; i < iterations; i++)
+                {
+                    text_scan::metrics_t m = text_scan::measure(sample, len);
+                    checksum += m.num_lines + m.max_line_len;
+                }
+                Uint64 time_measure = SDL_GetTicksNS() - start;
+
+                start = SDL_GetTicksNS();
+                for (int i = 0; i < iterations; i++)
+                {
+                    text_scan::metrics_t m = text_scan::measure_scalar(sample, len);
+                    checksum += m.num_lines + m.max_line_len;
+                }
+                Uint64 time_scalar = SDL_GetTicksNS() - start;
+
+                AddLog("%zu bytes: reference %.1f ns, scalar %.1f ns, measure %.1f ns (%zu)", len, double(time_reference) / iterations,
+                    double(time_scalar) / iterations, double(time_measure) / iterations, checksum % 10);
+            }
+            return 0;
+        });
+
+        AddCommand("_con_test_command_tokenizer", [=](const int argc, const char* argv[]) -> int {
+            int iterations = (argc > 1) ? SDL_max(atoi(argv[1]), 1) : 100000;
+            int failures = 0;
+
+            /* Arguments joined with '|' */
+            auto join = [](const command_tokenizer_t& t) -> std::string {
+                std::string out;
+                for (int i = 0; i < t.argc; i++)
+                    out.append(i ? "|" : "").append(t.argv[i]);
+                return out;
+            };
+
+            struct
+            {
+                const char* line;
+                command_tokenizer_t::result_t result;
+                const char* args;
+                size_t consumed;
+            } cases[] = {
+                { "", command_tokenizer_t::RESULT_EMPTY, "", 0 },
+                { " \t ", command_tokenizer_t::RESULT_EMPTY, "", 3 },
+                { "cmd a b", command_tokenizer_t::RESULT_OK, "cmd|a|b", 7 },
+                { "  cmd\t a  ", command_tokenizer_t::RESULT_OK, "cmd|a", 10 },
+                { "cmd \"a b\" c", command_tokenizer_t::RESULT_OK, "cmd|a b|c", 11 },
+                { "cmd a\"b c\"d", command_tokenizer_t::RESULT_OK, "cmd|ab cd", 11 },
+                { "cmd \"\" x", command_tokenizer_t::RESULT_OK, "cmd||x", 8 },
+                { "cmd \\\"x\\\"", command_tokenizer_t::RESULT_OK, "cmd|\"x\"", 9 },
+                { "cmd \"\\\\\"", command_tokenizer_t::RESULT_OK, "cmd|\\", 8 },
+                { "cmd \"\\\\\\\"\"", command_tokenizer_t::RESULT_OK, "cmd|\\\"", 10 },
+                { "cmd C:\\dir\\", command_tokenizer_t::RESULT_OK, "cmd|C:\\dir\\", 11 },
+                { "cmd \"C:\\dir\\\\\"", command_tokenizer_t::RESULT_OK, "cmd|C:\\dir\\", 14 },
+                { "cmd \"\\\\server\\share\"", command_tokenizer_t::RESULT_OK, "cmd|\\\\server\\share", 20 },
+                { "cmd 'a b'", command_tokenizer_t::RESULT_OK, "cmd|'a|b'", 9 },
+                { "a 1; b 2", command_tokenizer_t::RESULT_OK, "a|1", 4 },
+                { ";; a", command_tokenizer_t::RESULT_EMPTY, "", 1 },
+                { "cmd \"a;b\";c", command_tokenizer_t::RESULT_OK, "cmd|a;b", 10 },
+                { "cmd \"ab", command_tokenizer_t::RESULT_UNTERMINATED_QUOTE, "cmd|ab", 7 },
+            };
+
+            command_tokenizer_t tokens;
+            for (auto& c : cases)
+            {
+                size_t consumed = 0;
+                command_tokenizer_t::result_t result = tokens.tokenize(c.line, strlen(c.line), consumed);
+                std::string args = join(tokens);
+                if (result != c.result || args != c.args || consumed != c.consumed || tokens.argv[tokens.argc] != NULL)
+                {
+                    dc_log_error("'%s': result %d (Expected %d), args '%s' (Expected '%s'), consumed %zu (Expected %zu)", c.line, result, c.result,
+                        args.c_str(), c.args, consumed, c.consumed);
+                    failures++;
+                }
+            }
+
+            /* Fuzz: Every line must be consumed with progress, and quoting the arguments back up must give the same arguments */
+            const char alphabet[] = "ab ;\"\\\t'";
+            Uint64 rng = SDL_GetTicksNS();
+            std::string line;
+            std::string requoted;
+            std::vector<std::string> args;
+            command_tokenizer_t tokens_requoted;
+            for (int it = 0; it < iterations && failures < 10; it++)
+            {
+                /* Mostly short lines, with some long enough to use the heap buffers */
+                size_t len = SDL_rand_r(&rng, (it % 16) ? 48 : 4096);
+                line.resize(len);
+                for (size_t i = 0; i < len; i++)
+                    line[i] = alphabet[SDL_rand_r(&rng, sizeof(alphabet) - 1)];
+
+                const char* cur = line.c_str();
+                size_t remaining = len;
+                while (remaining && failures < 10)
+                {
+                    size_t consumed = 0;
+                    command_tokenizer_t::result_t result = tokens.tokenize(cur, remaining, consumed);
+                    bool empty = result == command_tokenizer_t::RESULT_EMPTY;
+                    if (!consumed || consumed > remaining || tokens.argv[tokens.argc] != NULL || empty == (tokens.argc > 0))
+                    {
+                        dc_log_error("'%s': consumed %zu of %zu, argc %d, result %d", cur, consumed, remaining, tokens.argc, result);
+                        failures++;
+                        break;
+                    }
+
+                    args.assign(tokens.argv, tokens.argv + tokens.argc);
+                    requoted.clear();
+                    for (const std::string& arg : args)
+                    {
+                        if (!requoted.empty())
+                            requoted += ' ';
+                        command_tokenizer_t::append_quoted(requoted, arg.data(), arg.size());
+                    }
+
+                    size_t consumed_requoted = 0;
+                    tokens_requoted.tokenize(requoted.c_str(), requoted.length(), consumed_requoted);
+                    bool same = consumed_requoted == requoted.length() && size_t(tokens_requoted.argc) == args.size();
+                    for (int i = 0; same && i < tokens_requoted.argc; i++)
+                        same = args[i] == tokens_requoted.argv[i];
+                    if (!same)
+                    {
+                        dc_log_error("'%.*s': requoted as '%s' tokenizes differently", int(consumed), cur, requoted.c_str());
+                        failures++;
+                    }
+
+                    cur += consumed;
+                    remaining -= consumed;
+                }
+            }
+
+            if (failures)
+                return 1;
+
+            AddLog("Passed %d fixed cases and %d fuzzed lines", int(SDL_arraysize(cases)), iterations);
+            return 0;
+        });
+
+        AddCommand("_con_test_convar_generations", [=](const int argc, const char* argv[]) -> int {
+            int iterations = (argc > 1) ? SDL_clamp(atoi(argv[1]), 1, 1 << 30) : 100000;
+            int failures = 0;
+            auto expect = [&](bool ok, const char* what) {
+                if (ok)
+                    return;
+                dc_log_error("%s", what);
+                failures++;
+            };
+
+            convar_int_t& cvr = con_test_generation_cvr;
+            convar_int_t& cvr_deferred = con_test_generation_deferred_cvr;
+            convar_group_t group = { &cvr };
+            convar_group_t group_other = { &cvr_deferred };
+            cvr.set(0);
+
+            /* Generations */
+            Uint64 start = convar_t::get_registry_generation();
+            cvr.set(1);
+            expect(cvr.get_generation() > start, "set() did not advance the generation of the convar");
+            expect(convar_t::get_registry_generation() >= cvr.get_generation(), "The registry generation is behind the generation of a convar");
+            expect(group.changed_since(start), "A group did not report a change to its convar");
+            expect(!group_other.changed_since(start), "A group reported a change to a convar it does not contain");
+            Uint64 last_seen = start;
+            expect(group.poll(last_seen) && !group.poll(last_seen), "poll() did not report a change exactly once");
+            expect(!cvr.set(-1) && !group.poll(last_seen), "A failed set() advanced the generation");
+
+            /* Listeners, including one that removes itself while the listeners are being run */
+            int calls_a = 0;
+            int calls_self = 0;
+            int calls_b = 0;
+            int handle_self = 0;
+            int handle_a = cvr.add_listener([&]() { calls_a++; });
+            handle_self = cvr.add_listener([&]() {
+                calls_self++;
+                cvr.remove_listener(handle_self);
+            });
+            int handle_b = cvr.add_listener([&]() { calls_b++; });
+            cvr.set(2);
+            cvr.set(3);
+            expect(calls_a == 2 && calls_self == 1 && calls_b == 2, "A listener removing itself disturbed the other listeners");
+            cvr.remove_listener(handle_a);
+            cvr.set(4);
+            expect(calls_a == 2 && calls_b == 3, "remove_listener() did not remove the listener");
+            cvr.remove_listener(handle_b);
+
+            /* Deferred listeners run once per flush */
+            int calls_deferred = 0;
+            int handle_deferred = cvr_deferred.add_listener([&]() { calls_deferred++; });
+            for (int i = 1; i <= 3; i++)
+                cvr_deferred.set(i);
+            expect(calls_deferred == 0, "A deferred listener ran before the flush");
+            convar_t::flush_deferred_callbacks();
+            expect(calls_deferred == 1, "A deferred listener did not run exactly once per flush");
+            cvr_deferred.remove_listener(handle_deferred);
+
+            /* A thread polling the group must end up with the final value, however its polls interleave with set() */
+            std::atomic<bool> stop { false };
+            int seen_value = -1;
+            std::thread poller([&]() {
+                Uint64 poller_last_seen = start;
+                for (bool stopping = false; !stopping;)
+                {
+                    stopping = stop.load(std::memory_order_acquire);
+                    if (group.poll(poller_last_seen))
+                        seen_value = cvr.get();
+                }
+            });
+            for (int i = 1; i <= iterations; i++)
+                cvr.set(i);
+            stop.store(true, std::memory_order_release);
+            poller.join();
+            expect(seen_value == iterations, "A thread polling a group missed the last change");
+
+            cvr.set(0);
+            cvr_deferred.set(0);
+            convar_t::flush_deferred_callbacks();
+
+            if (failures)
+                return 1;
+
+            AddLog("Passed, with %d sets polled from another thread", iterations);
+            return 0;
+        });
+
+        AddCommand("_con_test_convar_publish", [=](const int argc, const char* argv[]) -> int {
+            int iterations = (argc > 1) ? SDL_clamp(atoi(argv[1]), 1, 1 << 30) : 100000;
+            int num_readers = (argc > 2) ? SDL_clamp(atoi(argv[2]), 1, 64) : 4;
+
+            /* Long enough to not fit in the small string buffer, so a freed snapshot would be read through a freed heap block */
+            const std::string values[] = {
+                std::string(64, 'a'),
+                std::string(64, 'b'),
+                std::string(64, 'c'),
+            };
+            convar_string_t& cvr = con_test_publish_cvr;
+            cvr.set(values[0]);
+            cvr.set_default(values[0]);
+
+            /* Readers keep entering the window between loading a snapshot and taking a reference while it is published twice */
+            std::atomic<bool> stop { false };
+            std::atomic<int> bad_reads { 0 };
+            std::vector<std::thread> readers;
+            for (int i = 0; i < num_readers; i++)
+                readers.emplace_back([&, i]() {
+                    while (!stop.load(std::memory_order_acquire))
+                    {
+                        convar_string_t::ref_t ref = (i & 1) ? cvr.get_default_ref() : cvr.get_ref();
+                        if (ref.str() != values[0] && ref.str() != values[1] && ref.str() != values[2])
+                            bad_reads.fetch_add(1, std::memory_order_relaxed);
+                    }
+                });
+
+            /* Back to back publishes, as an exec script setting the same convar twice or set() followed by set_default() would */
+            for (int i = 0; i < iterations; i++)
+            {
+                cvr.set(values[1 + (i & 1)]);
+                cvr.set(values[i % 3]);
+                cvr.set_default(values[1 + (i & 1)]);
+                cvr.set_default(values[i % 3]);
+            }
+            stop.store(true, std::memory_order_release);
+            for (std::thread& t : readers)
+                t.join();
+
+            cvr.set("");
+            cvr.set_default("");
+
+            if (bad_reads.load())
+            {
+                dc_log_error("%d reads returned a value that was never set", bad_reads.load());
+                return 1;
+            }
+
+            AddLog("Passed, with %d double publishes read from %d threads", iterations, num_readers);
+            return 0;
+        });
+
+        AddCommand("_con_bench_exec", [=](const int argc, const char* argv[]) -> int {
+            if (argc < 2)
+            {
+                AddLog("Usage: %s <script path> [iterations]", argv[0]);
+                return 1;
+            }
+            int iterations = (argc > 2) ? SDL_max(atoi(argv[2]), 1) : 1000;
+
+            Uint64 start = SDL_GetTicksNS();
+            for (int i = 0; i < iterations; i++)
+            {
+                script_cache.erase(argv[1]);
+                if (!GetScript(argv[1]))
+                    return 1;
+            }
+            Uint64 time_compile = SDL_GetTicksNS() - start;
+
+            start = SDL_GetTicksNS();
+            for (int i = 0; i < iterations; i++)
+                GetScript(argv[1]);
+            Uint64 time_cached = SDL_GetTicksNS() - start;
+
+            std::shared_ptr<console_script_t> script = GetScript(argv[1]);
+            start = SDL_GetTicksNS();
+            for (int i = 0; i < iterations; i++)
+                ExecScript(*script);
+            Uint64 time_replay = SDL_GetTicksNS() - start;
+
+            AddLog("%zu commands: read and tokenize %.2f us, cache hit %.2f us, replay %.2f us", script->commands.size(),
+                double(time_compile) / iterations / 1000.0, double(time_cached) / iterations / 1000.0, double(time_replay) / iterations / 1000.0);
+            return 0;
+        });
+
+        AddCommand("_con_bench_convar_lookup", [=](const int argc, const char* argv[]) -> int {
+            int iterations = (argc > 1) ? SDL_max(atoi(argv[1]), 1) : 1000;
+
+            std::vector<convar_t*>* list = convar_t::get_convar_list();
+            std::vector<Uint32> hashes;
+            for (convar_t* cvr : *list)
+                hashes.push_back(convar_t::hash_name(cvr->get_name()));
+
+            /* The strcmp() loop that the hash index replaced */
+            auto find_linear = [list](const char* name) -> convar_t* {
+                for (convar_t* cvr : *list)
+                    if (strcmp(name, cvr->get_name()) == 0)
+                        return cvr;
+                return NULL;
+            };
+
+            size_t misses = 0;
+            Uint64 start = SDL_GetTicksNS();
+            for (int i = 0; i < iterations; i++)
+                for (convar_t* cvr : *list)
+                    misses += find_linear(cvr->get_name()) != cvr;
+            Uint64 time_linear = SDL_GetTicksNS() - start;
+
+            start = SDL_GetTicksNS();
+            for (int i = 0; i < iterations; i++)
+                for (convar_t* cvr : *list)
+                    misses += convar_t::get_convar(cvr->get_name()) != cvr;
+            Uint64 time_hashed = SDL_GetTicksNS() - start;
+
+            start = SDL_GetTicksNS();
+            for (int i = 0; i < iterations; i++)
+                for (size_t j = 0; j < list->size(); j++)
+                    misses += convar_t::get_convar(list->at(j)->get_name(), hashes[j]) != list->at(j);
+            Uint64 time_prehashed = SDL_GetTicksNS() - start;
+
+            double lookups = double(iterations) * list->size();
+            AddLog("%zu convars: linear %.1f ns, hashed %.1f ns, prehashed %.1f ns per lookup (%zu misses)", list->size(), time_linear / lookups,
+                time_hashed / lookups, time_prehashed / lookups, misses);
+            return misses != 0;
+        });
+
+        AddCommand("_con_bench_convar_string", [=](const int argc, const char* argv[]) -> int {
+            const char* name = (argc > 1) ? argv[1] : "user_config_path";
+            int iterations = (argc > 2) ? SDL_max(atoi(argv[2]), 1) : 100000;
+
+            convar_t* cvr = convar_t::get_convar(name);
+            if (!cvr || cvr->get_convar_type() != convar_t::CONVAR_TYPE::CONVAR_TYPE_STRING)
+            {
+                dc_log_error("\"%s\" is not a string convar", name);
+                AddLog("Usage: %s [string convar (Default: user_config_path)] [iterations]", argv[0]);
+                return 1;
+            }
+            convar_string_t* cvr_string = (convar_string_t*)cvr;
+
+            /* Polling with a copy, as call sites did with get().c_str() */
+            size_t checksum = 0;
+            Uint64 start = SDL_GetTicksNS();
+            for (int i = 0; i < iterations; i++)
+                checksum += strlen(cvr_string->get().c_str());
+            Uint64 time_get = SDL_GetTicksNS() - start;
+
+            start = SDL_GetTicksNS();
+            for (int i = 0; i < iterations; i++)
+                checksum += strlen(cvr_string->get_ref().c_str());
+            Uint64 time_ref = SDL_GetTicksNS() - start;
+
+            start = SDL_GetTicksNS();
+            for (int i = 0; i < iterations; i++)
+                checksum += cvr_string->get() == cvr_string->get_default();
+            Uint64 time_cmp_get = SDL_GetTicksNS() - start;
+
+            start = SDL_GetTicksNS();
+            for (int i = 0; i < iterations; i++)
+                checksum += cvr_string->get_ref() == cvr_string->get_default_ref();
+            Uint64 time_cmp_ref = SDL_GetTicksNS() - start;
+
+            AddLog("\"%s\" (%zu bytes): get() %.1f ns, get_ref() %.1f ns, compare to default with get() %.1f ns, with get_ref() %.1f ns (%zu)",
+                name, cvr_string->get_ref().size(), double(time_get) / iterations, double(time_ref) / iterations, double(time_cmp_get) / iterations,
+                double(time_cmp_ref) / iterations, checksum % 10);
+            return 0;
+        });
+
+        AddCommand("_con_bench_command_tokenizer", [=](const int argc, const char* argv[]) -> int {
+            int iterations = (argc > 1) ? SDL_max(atoi(argv[1]), 1) : 100000;
+
+            /* Lines like those replayed from the config file by convar_file_parser::read() */
+            const char* samples[] = {
+                "r_vsync \"1\"",
+                "user_config_path \"/user_cfg.txt\"",
+                "console_log_recorder_kb \"256\"; console_overlay \"2\"; gui_scale \"1.500000\"",
+            };
+
+            command_tokenizer_t tokens;
+            for (const char* sample : samples)
+            {
+                size_t len = strlen(sample);
+                size_t checksum = 0;
+
+                Uint64 start = SDL_GetTicksNS();
+                for (int i = 0; i < iterations; i++)
+                {
+                    const char* cur = sample;
+                    size_t remaining = len;
+                    while (remaining)
+                    {
+                        size_t consumed = 0;
+                        tokens.tokenize(cur, remaining, consumed);
+                        checksum += tokens.argc;
+                        cur += consumed;
+                        remaining -= consumed;
+                    }
+                }
+                Uint64 time_tokenize = SDL_GetTicksNS() - start;
+
+                AddLog("%zu bytes: tokenize %.1f ns (%zu)", len, double(time_tokenize) / iterations, checksum % 10);
+            }
+
+            /* Whole path of a command, including History and the command lookup */
+            Uint64 start = SDL_GetTicksNS();
+            for (int i = 0; i < iterations; i++)
+                ExecCommand("_con_test_returncode 0", true);
+            Uint64 time_exec = SDL_GetTicksNS() - start;
+            AddLog("ExecCommand(\"_con_test_returncode 0\"): %.1f ns", double(time_exec) / iterations);
+
+            return 0;
+        });
+
+        AutoScroll = true;
+        ScrollToBottom = false;
+
+        console_constructed.store(true, std::memory_order_release);
+    }
+    ~AppConsole()
+    {
+        console_constructed.store(false, std::memory_order_release);
+        stop_filter_thread();
+        stop_search_thread();
+        stop_export_thread();
+        ClearLog();
+        for (int i = 0; i < History.Size; i++)
+            free(History[i]);
+    }
+
+    // Portable helpers
+    static int Stricmp(const char* s1, const char* s2)
+    {
+        int d;
+        while ((d = toupper(*s2) - toupper(*s1)) == 0 && *s1)
+        {
+            s1++;
+            s2++;
+        }
+        return d;
+    }
+    static int Strnicmp(const char* s1, const char* s2, int n)
+    {
+        int d = 0;
+        while (n > 0 && (d = toupper(*s2) - toupper(*s1)) == 0 && *s1)
+        {
+            s1++;
+            s2++;
+            n--;
+        }
+        return d;
+    }
+    static char* Strdup(const char* s)
+    {
+        IM_ASSERT(s);
+        size_t len = strlen(s) + 1;
+        void* buf = malloc(len);
+        IM_ASSERT(buf);
+        return (char*)memcpy(buf, (const void*)s, len);
+    }
+    static void Strtrim(char* s)
+    {
+        char* str_end = s + strlen(s);
+        while (str_end > s && str_end[-1] == ' ')
+            str_end--;
+        *str_end = 0;
+    }
+
+    /**
+     * Acquire mutex_log, and update log_stats.lock_contended if the mutex was already held
+     */
+    std::unique_lock<std::mutex> lock_log()
+    {
+        std::unique_lock<std::mutex> lock(mutex_log, std::try_to_lock);
+        if (lock.owns_lock())
+            return lock;
+        log_stats.lock_contended.fetch_add(1, std::memory_order_relaxed);
+        lock.lock();
+        return lock;
+    }
+
+    /**
+     * Write a line of log_dump or log_recover output to out, or to the console if out is NULL
+     *
+     * @param time Wall clock time in nanoseconds since the unix epoch
+     */
+    void dump_line(PHYSFS_File* out, Sint64 time, const char* text)
+    {
+        SDL_DateTime dt;
+        SDL_zero(dt);
+        SDL_TimeToDateTime(time, &dt, true);
+
+        char line[VA_BUF_LEN + 32];
+        int len = snprintf(line, sizeof(line), "[%04d-%02d-%02d %02d:%02d:%02d.%03d] %s", dt.year, dt.month, dt.day, dt.hour, dt.minute, dt.second,
+            dt.nanosecond / 1000000, text);
+        if (out)
+        {
+            len = SDL_min(size_t(len), sizeof(line) - 1);
+            PHYSFS_writeBytes(out, line, len);
+            if (!len || line[len - 1] != '\n')
+                PHYSFS_writeBytes(out, "\n", 1);
+        }
+        else
+            AddLogQuiet("%s", line);
+    }
+
+    void ClearLog()
+    {
+        std::unique_lock<std::mutex> lock = lock_log();
+        Items.clear();
+        recent.clear();
+    }
+
+    void AddLogQuiet(const char* fmt, ...) IM_FMTARGS(2)
+    {
+        char buf[VA_BUF_LEN];
+        decode_variadic_to_buffer(buf, fmt);
+
+        log_item_t l;
+        l.time = SDL_GetTicks();
+        l.repeat = 1;
+        l.suppressed = 0;
+        l.str = buf;
+        l.fmt = NULL;
+        l.quiet = false;
+        l.str_fname = __FILE_NAME__;
+        l.str_func = __func__;
+        l.line = __LINE__;
+
+        if (strstr(buf, "[error]"))
+            l.lvl = dev_console::LEVEL_ERROR;
+        else if (strstr(buf, "[warn]"))
+            l.lvl = dev_console::LEVEL_WARN;
+        else if (strstr(buf, "[trace]"))
+            l.lvl = dev_console::LEVEL_TRACE;
+        else if (strncmp(buf, "# ", 2) == 0)
+            l.lvl = dev_console::LEVEL_INTERNAL_CMD;
+        else
+            l.lvl = dev_console::LEVEL_INTERNAL;
+
+        push_back_log(l, true);
+    }
+
+    /**
+     * Push back the a log item to log_queue, to be moved to Items by drain_log()
+     *
+     * Safe to call from any thread, this never blocks on mutex_log
+     *
+     * @param l The log item to push back
+     * @param quiet Whether to print the log item to the console or not
+     */
+    void push_back_log(log_item_t l, bool quiet)
+    {
+        l.quiet = quiet;
+        enqueue_log(l, strlen(l.str));
+    }
+
+    /**
+     * Populate the fields line_width and num_lines, and queue the log item for stdout
+     *
+     * line_width is only an estimate until the item is drawn
+     *
+     * Callers must hold mutex_log
+     *
+     * @param l The log item to prepare, l.text must be set
+     * @param print Queue the item for stdout (Ignored if l.quiet is set)
+     */
+    void prepare_log(log_item_t& l, bool print)
+    {
+        char buf[VA_BUF_LEN];
+        const char* text = l.display_text(buf, IM_ARRAYSIZE(buf));
+        size_t text_len = strlen(text);
+        text_scan::metrics_t metrics = text_scan::measure(text, text_len);
+        l.line_width = metrics.max_line_len * dev_console::add_log_font_width;
+        l.width_key = 0;
+        l.num_lines = metrics.num_lines;
+
+        if (print && !l.quiet)
+            sink.append(text, text_len);
+    }
+
+    /** Value of repeat for the newest item in Items when it was last queued for stdout */
+    Uint32 repeat_printed = 0;
+
+    /**
+     * Queue the newest item for stdout again if more repeats were collapsed into it since it was last printed
+     *
+     * Callers must hold mutex_log
+     */
+    void report_repeats_locked()
+    {
+        if (!Items.size())
+            return;
+
+        log_item_t& last = Items[Items.size() - 1];
+        if (last.repeat <= repeat_printed || last.quiet)
+            return;
+
+        char buf[VA_BUF_LEN];
+        const char* text = last.display_text(buf, IM_ARRAYSIZE(buf));
+        sink.append(text, strlen(text));
+        repeat_printed = last.repeat;
+    }
+
+    /**
+     * Check if l is a repeat of last that can be collapsed into it
+     */
+    static bool is_repeat(const log_item_t& last, const log_item_t& l)
+    {
+        if (last.lvl != l.lvl || last.line != l.line || last.quiet != l.quiet || l.suppressed || last.repeat == SDL_MAX_UINT32)
+            return false;
+        if (last.str_fname != l.str_fname || last.str_func != l.str_func)
+            return false;
+        return strcmp(last.str, l.str) == 0;
+    }
+
+    /**
+     * Push a log item onto log_queue
+     *
+     * Safe to call from any thread, this never blocks on mutex_log
+     *
+     * @param l The log item to push back, if l.fmt is set then l.str is a captured payload
+     * @param str_len Length of l.str (or the payload), excluding the null terminator
+     */
+    void enqueue_log(const log_item_t& l, size_t str_len)
+    {
+        log_stats.enqueued.fetch_add(1, std::memory_order_relaxed);
+
+        /* Items logged from static constructors wait in log_queue, which lives in zero initialized storage, until the console exists */
+        const bool constructed = console_constructed.load(std::memory_order_acquire);
+
+        /* Help out the event thread if it has fallen behind, but never wait for it */
+        if (constructed && log_queue.size_approx() > LOG_QUEUE_SIZE / 2 && mutex_log.try_lock())
+        {
+            std::lock_guard<std::mutex> lock(mutex_log, std::adopt_lock);
+            drain_log_locked();
+        }
+
+        while (!log_queue.try_push(l, str_len))
+        {
+            log_stats.queue_full.fetch_add(1, std::memory_order_relaxed);
+            if (!constructed)
+                return;
+            if (mutex_log.try_lock())
+            {
+                std::lock_guard<std::mutex> lock(mutex_log, std::adopt_lock);
+                drain_log_locked();
+            }
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    /**
+     * Move all items from log_queue to Items, and resize Items if console_log_budget_kb has changed
+     *
+     * Callers must hold mutex_log
+     */
+    void drain_log_locked()
+    {
+        size_t budget = size_t(console_log_budget_kb.get()) * 1024;
+        if (!Items.is_init())
+            Items.init(budget);
+        else if (Items.budget_bytes != budget)
+            Items.resize(budget);
+
+        bool collapse = console_log_collapse.get();
+        bool to_file = console_log_file.get();
+
+        Uint64 batch = 0;
+        log_queue_t::slot_t* slot;
+        while ((slot = log_queue.front()) != NULL)
+        {
+            char buf[VA_BUF_LEN];
+            log_item_t l = slot->item;
+            size_t str_len = slot->str_len;
+            const char* fmt = l.fmt;
+            if (l.fmt)
+            {
+                str_len = log_format::format(buf, IM_ARRAYSIZE(buf), l.fmt, l.str, str_len);
+                l.str = buf;
+                l.fmt = NULL;
+            }
+            batch++;
+
+            if (collapse && Items.size())
+            {
+                log_item_t& last = Items[Items.size() - 1];
+                if (is_repeat(last, l))
+                {
+                    last.repeat++;
+                    last.time = l.time;
+                    prepare_log(last, false);
+                    Items.update_back();
+                    recent.update_back(last);
+                    recorder.write_repeat(1);
+                    log_stats.collapsed.fetch_add(1, std::memory_order_relaxed);
+                    if (to_file && !l.quiet)
+                        file_repeats++;
+                    log_queue.pop();
+                    continue;
+                }
+            }
+
+            /* Room for the prefix on top of a full length message */
+            char text[VA_BUF_LEN + 256];
+            size_t prefix_len = l.format_prefix(text, IM_ARRAYSIZE(text));
+            str_len = SDL_min(str_len, IM_ARRAYSIZE(text) - prefix_len - 1);
+            memcpy(text + prefix_len, l.str, str_len);
+            text[prefix_len + str_len] = '\0';
+            l.text = text;
+            l.str = text + prefix_len;
+
+            report_repeats_locked();
+            prepare_log(l, true);
+            Items.push_back(l, prefix_len + str_len);
+            recent.push(Items[Items.size() - 1]);
+            recorder.write_text(l.time, l.lvl, l.text, prefix_len + str_len);
+            if (to_file && !l.quiet)
+            {
+                if (fmt)
+                    file_record_locked(l, fmt, slot->item.str, slot->str_len);
+                else
+                    file_record_locked(l, NULL, l.str, str_len);
+            }
+            log_queue.pop();
+            repeat_printed = l.repeat;
+        }
+
+        if (!batch)
+            return;
+
+        log_stats.drained.fetch_add(batch, std::memory_order_relaxed);
+        if (batch > log_stats.drained_max_batch.load(std::memory_order_relaxed))
+            log_stats.drained_max_batch.store(batch, std::memory_order_relaxed);
+    }
+
+    /**
+     * A callsite that has an id in the log file, keyed by content because add_log() accepts strings that the caller may free or reuse
+     */
+    struct file_callsite_t
+    {
+        std::string fname;
+        std::string func;
+        std::string fmt;
+        int line;
+        int lvl;
+
+        bool matches(const char* _fname, const char* _func, const char* _fmt, int _line, int _lvl) const
+        {
+            return line == _line && lvl == _lvl && fname == _fname && func == _func && fmt == _fmt;
+        }
+    };
+
+    static Uint32 file_callsite_hash(const char* fname, const char* func, const char* fmt, int line, int lvl)
+    {
+        Uint32 h = 0x811c9dc5u;
+        for (const char* str : { fname, func, fmt })
+        {
+            for (; *str; str++)
+                h = (h ^ Uint8(*str)) * 0x01000193u;
+            h = (h ^ 0xff) * 0x01000193u;
+        }
+        return (h ^ Uint32(line * 8 + lvl + 2)) * 0x01000193u;
+    }
+
+    /** Most callsites given an id in the log file, so that the callsite records repeated at the start of every file stay bounded */
+    static constexpr Uint32 FILE_CALLSITE_MAX = 4096;
+
+    /** Id redefined right before every message from a callsite that did not fit in FILE_CALLSITE_MAX */
+    static constexpr Uint32 FILE_CALLSITE_OVERFLOW = FILE_CALLSITE_MAX;
+
+    /** Records waiting to be written to the log file, guarded by mutex_log */
+    log_sink_t file_sink;
+
+    /** Callsites that have been written to file_callsites, indexed by id, guarded by mutex_log */
+    std::vector<file_callsite_t> file_callsite_list;
+
+    /** Ids in file_callsite_list by file_callsite_hash(), guarded by mutex_log */
+    std::unordered_multimap<Uint32, Uint32> file_callsite_ids;
+
+    /** Every callsite record written so far, guarded by mutex_log */
+    std::vector<char> file_callsites;
+
+    /** Repeats of the last record collapsed since it was written, guarded by mutex_log */
+    Uint32 file_repeats = 0;
+
+    /**
+     * Write a record for any repeats collapsed into the previous record
+     *
+     * Callers must hold mutex_log
+     */
+    void file_flush_repeats_locked()
+    {
+        if (!file_repeats)
+            return;
+        char buf[16];
+        file_sink.append_raw(buf, log_file::encode_repeat(buf, sizeof(buf), file_repeats), true);
+        file_repeats = 0;
+    }
+
+    /**
+     * Queue a record for the log file
+     *
+     * Callers must hold mutex_log
+     *
+     * @param l Item to record
+     * @param fmt Format string if data is a payload from log_format::capture(), otherwise NULL
+     * @param data Payload or formatted message
+     * @param data_len Length of data
+     */
+    void file_record_locked(const log_item_t& l, const char* fmt, const char* data, size_t data_len)
+    {
+        file_flush_repeats_locked();
+
+        /* Room for a callsite record of an overflowing callsite in front of the message */
+        char buf[2 * log_file::max_record_size(VA_BUF_LEN)];
+
+        const char* fname = l.str_fname ? l.str_fname : "";
+        const char* func = l.str_func ? l.str_func : "";
+        const char* fmt_str = fmt ? fmt : "";
+        Uint32 hash = file_callsite_hash(fname, func, fmt_str, l.line, l.lvl);
+
+        Uint32 id = FILE_CALLSITE_OVERFLOW;
+        auto range = file_callsite_ids.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (file_callsite_list[it->second].matches(fname, func, fmt_str, l.line, l.lvl))
+            {
+                id = it->second;
+                break;
+            }
+        }
+
+        size_t len = 0;
+        if (id == FILE_CALLSITE_OVERFLOW && file_callsite_list.size() < FILE_CALLSITE_MAX)
+        {
+            id = file_callsite_list.size();
+            len = log_file::encode_callsite(buf, sizeof(buf), VA_BUF_LEN, id, fname, func, l.line, l.lvl, fmt_str);
+            file_callsites.insert(file_callsites.end(), buf, buf + len);
+            file_sink.append_raw(buf, len, true);
+            file_callsite_list.push_back({ fname, func, fmt_str, l.line, l.lvl });
+            file_callsite_ids.insert(std::make_pair(hash, id));
+            len = 0;
+        }
+        else if (id == FILE_CALLSITE_OVERFLOW)
+        {
+            /* Written in the same call as the message, so that a new file can not be started between the two */
+            len = log_file::encode_callsite(buf, sizeof(buf), VA_BUF_LEN, id, fname, func, l.line, l.lvl, fmt_str);
+        }
+
+        len += log_file::encode_message(buf + len, sizeof(buf) - len, fmt != NULL, l.time, id, l.suppressed, data, data_len);
+        file_sink.append_raw(buf, len, true);
+    }
+
+    /**
+     * Move all pending log items to Items
+     *
+     * Should be called once per frame from the event thread
+     */
+    void drain_log()
+    {
+        std::unique_lock<std::mutex> lock = lock_log();
+        drain_log_locked();
+    }
+
+    /** Serializes writers of stdout so that output stays in order, always acquired before mutex_log */
+    std::mutex mutex_write;
+
+    log_sink_t sink;
+
+    std::mutex mutex_sink;
+    std::condition_variable cond_sink;
+    std::thread thread_sink;
+    bool sink_stop = false;
+    std::atomic<bool> sink_started { false };
+
+    /**
+     * Move all pending log items to Items and write everything waiting for stdout before returning
+     *
+     * Safe to call from any thread that does not hold mutex_log, unless wait is false
+     *
+     * @param wait If false, return without flushing instead of waiting for mutex_write or mutex_log
+     *
+     * @returns true if the log was flushed
+     */
+    bool flush_log(bool wait = true)
+    {
+        std::unique_lock<std::mutex> lock_write(mutex_write, std::defer_lock);
+        if (wait)
+            lock_write.lock();
+        else if (!lock_write.try_lock())
+            return false;
+
+        std::vector<log_sink_t::block_t*> blocks;
+        std::vector<log_sink_t::block_t*> file_blocks;
+        std::unique_lock<std::mutex> lock(mutex_log, std::defer_lock);
+        if (wait)
+            lock = lock_log();
+        else if (!lock.try_lock())
+            return false;
+        drain_log_locked();
+        report_repeats_locked();
+        blocks.swap(sink.pending);
+        if (file_allowed)
+        {
+            file_flush_repeats_locked();
+            file_blocks.swap(file_sink.pending);
+            if (file_callsites_copy.size() < file_callsites.size())
+                file_callsites_copy.insert(file_callsites_copy.end(), file_callsites.begin() + file_callsites_copy.size(), file_callsites.end());
+        }
+        lock.unlock();
+
+        log_sink_t::write(blocks);
+
+        /* Records never straddle blocks, so a new file can be started between any two blocks */
+        Sint64 file_max_size = Sint64(console_log_file_max_kb.get()) * 1024;
+        int file_max_count = console_log_file_count.get();
+        for (log_sink_t::block_t* b : file_blocks)
+            if (file_writer.prepare(file_max_size, file_max_count, file_callsites_copy))
+                file_writer.write(b->data, b->used);
+
+        lock.lock();
+        sink.spare.insert(sink.spare.end(), blocks.begin(), blocks.end());
+        file_sink.spare.insert(file_sink.spare.end(), file_blocks.begin(), file_blocks.end());
+        return true;
+    }
+
+    /** Set by open_log_file() once PhysFS is usable, guarded by mutex_write */
+    bool file_allowed = false;
+
+    /** Copy of file_callsites for file_writer, guarded by mutex_write */
+    std::vector<char> file_callsites_copy;
+
+    /** Guarded by mutex_write */
+    log_file::writer_t file_writer;
+
+    /**
+     * Allow log file records to be written to the PhysFS write dir
+     *
+     * Records queued before this are kept (Up to the block limit of file_sink) and written to the first file
+     */
+    void open_log_file()
+    {
+        {
+            std::lock_guard<std::mutex> lock_write(mutex_write);
+            file_allowed = true;
+        }
+        open_recorder();
+    }
+
+    /** Flight recorder, protected by mutex_log */
+    log_recorder recorder;
+
+    /**
+     * Keep the flight recorder of the previous session for log_recover, and start a new one if console_log_recorder_kb is set
+     */
+    void open_recorder()
+    {
+        PHYSFS_mkdir(LOG_RECORDER_DIR);
+        if (PHYSFS_exists(LOG_RECORDER_PATH) && !log_recorder::copy_file(LOG_RECORDER_PATH, LOG_RECORDER_PREV_PATH))
+            dc_log_error("Unable to keep the previous flight recorder: %s", PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+
+        size_t size = size_t(console_log_recorder_kb.get()) * 1024;
+        const char* write_dir = PHYSFS_getWriteDir();
+        if (!size)
+            PHYSFS_delete(LOG_RECORDER_PATH);
+        if (!size || !write_dir)
+            return;
+
+        std::string path = write_dir;
+        if (path.size() && path.back() != PHYSFS_getDirSeparator()[0])
+            path += PHYSFS_getDirSeparator();
+        path += LOG_RECORDER_DIR;
+        path += PHYSFS_getDirSeparator();
+        path += "recorder.trec";
+
+        std::unique_lock<std::mutex> lock = lock_log();
+        bool ok = recorder.open(path.c_str(), size);
+        lock.unlock();
+
+        if (!ok)
+            dc_log_error("Unable to map flight recorder \"%s\"", path.c_str());
+    }
+
+    /**
+     * Write out everything pending and close the log file, must be called before PhysFS is deinitialized
+     */
+    void close_log_file()
+    {
+        /* Let a running export finish writing, as it also uses PhysFS */
+        if (thread_export.joinable())
+            thread_export.join();
+
+        flush_log();
+        {
+            std::unique_lock<std::mutex> lock = lock_log();
+            recorder.close();
+        }
+        std::lock_guard<std::mutex> lock_write(mutex_write);
+        file_writer.close();
+        file_allowed = false;
+    }
+
+    /**
+     * Start the thread that periodically calls flush_log(), the thread is stopped by an atexit() handler
+     *
+     * Called by tetra::init() (See: dev_console::start_log_sink())
+     */
+    void start_sink()
+    {
+        std::lock_guard<std::mutex> lock(mutex_sink);
+        if (sink_started.load(std::memory_order_relaxed))
+            return;
+
+        sink_stop = false;
+        thread_sink = std::thread([this]() {
+            std::unique_lock<std::mutex> lock_thread(mutex_sink);
+            while (!sink_stop)
+            {
+                cond_sink.wait_for(lock_thread, std::chrono::milliseconds(console_log_flush_ms.get()));
+                lock_thread.unlock();
+                flush_log();
+                lock_thread.lock();
+            }
+        });
+        sink_started.store(true, std::memory_order_relaxed);
+
+        atexit(stop_log_sink);
+    }
+
+    /**
+     * Stop the sink thread and write out anything it left behind
+     */
+    void stop_sink()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_sink);
+            sink_stop = true;
+        }
+        cond_sink.notify_all();
+        if (thread_sink.joinable())
+            thread_sink.join();
+        flush_log();
+    }
+
+    void AddLog(const char* fmt, ...) IM_FMTARGS(2)
+    {
+        char buf[VA_BUF_LEN];
+        decode_variadic_to_buffer(buf, fmt);
 
         log_item_t l;
         l.time = SDL_GetTicks();
-        l.str = Strdup(buf);
+        l.repeat = 1;
+        l.suppressed = 0;
+        l.str = buf;
+        l.fmt = NULL;
+        l.quiet = false;
         l.str_fname = __FILE_NAME__;
-        l.str_func = __func__;
-        l.line = __LINE__;
+        l.str_func = "";
+        l.line = -1;
 
         if (strstr(buf, "[error]"))
             l.lvl = dev_console::LEVEL_ERROR;
@@ -377,123 +3109,582 @@ struct AppConsole
         else
             l.lvl = dev_console::LEVEL_INTERNAL;
 
-        push_back_log(l, true);
+        push_back_log(l, false);
+    }
+
+    /** Incremented whenever the font metrics that log_item_t::line_width is measured with change, never 0 */
+    Uint32 width_key = 1;
+    ImFont* width_font = NULL;
+    float width_font_size = 0.0f;
+    float width_add_log_font_width = 0.0f;
+
+    /**
+     * Invalidate every measured log_item_t::line_width if the current font or dev_console::add_log_font_width changed
+     */
+    void update_width_key()
+    {
+        ImFont* font = ImGui::GetFont();
+        float font_size = ImGui::GetFontSize();
+        float font_width = dev_console::add_log_font_width;
+        if (font == width_font && font_size == width_font_size && font_width == width_add_log_font_width)
+            return;
+
+        width_font = font;
+        width_font_size = font_size;
+        width_add_log_font_width = font_width;
+        if (++width_key == 0)
+            width_key = 1;
+    }
+
+    /**
+     * @param measure Measure the item with the current font and cache it, this should only be set when update_width_key() was called with the same font
+     */
+    inline void render_item(log_item_t& l, float line_height, float line_height_spacing, ImVec4& last_color, bool measure)
+    {
+        ImVec2 rect(l.line_width, line_height * (l.num_lines - 1) + line_height_spacing);
+        if (ImGui::IsRectVisible(rect))
+        {
+            char buf[VA_BUF_LEN];
+
+            const char* text = l.display_text(buf, IM_ARRAYSIZE(buf));
+            if (measure && l.width_key != width_key)
+            {
+                l.line_width = ImGui::CalcTextSize(text).x + ImGui::GetStyle().ItemSpacing.x * 2;
+                l.width_key = width_key;
+            }
+
+            ImVec4 new_color = l.get_color();
+
+            if (new_color != last_color)
+            {
+                if (last_color.x > -0.5f)
+                    ImGui::PopStyleColor();
+                ImGui::PushStyleColor(ImGuiCol_Text, new_color);
+            }
+
+            last_color = new_color;
+
+            ImGui::TextUnformatted(text);
+        }
+        else
+        {
+            rect.y = line_height * l.num_lines;
+            ImGui::Dummy(rect);
+        }
     }
 
+    /** Filters the backlog of Items when it is too big to do in a single frame, all filter_* members are protected by mutex_log */
+    std::thread thread_filter;
+    bool filter_busy = false;
+    bool filter_stop = false;
+
     /**
-     * Push back the a log item to Items and if necessary shrink Items
+     * Stop thread_filter, if it is running
      *
-     * Also populates the fields: line_width and num_lines
+     * @param lock Lock on mutex_log, which is released while waiting
+     */
+    void stop_filter_thread(std::unique_lock<std::mutex>& lock)
+    {
+        filter_stop = true;
+        lock.unlock();
+        if (thread_filter.joinable())
+            thread_filter.join();
+        lock.lock();
+        filter_stop = false;
+    }
+
+    void stop_filter_thread()
+    {
+        std::unique_lock<std::mutex> lock = lock_log();
+        stop_filter_thread(lock);
+    }
+
+    /**
+     * Bring filter_index up to date with Filter and Items
      *
-     * @param l The log item to push back
-     * @param quiet Whether to print the log item to the console or not
+     * Small backlogs are filtered in place, larger ones are handed to thread_filter, which only holds mutex_log for
+     * LOG_FILTER_SLICE_ITEMS items at a time
      */
-    void push_back_log(log_item_t l, bool quiet)
+    void update_filter_index()
     {
-        char buf[VA_BUF_LEN];
-        l.format_str(buf, IM_ARRAYSIZE(buf));
-        l.line_width = SDL_utf8strlen(buf);
-        l.num_lines = 0;
+        if (!Filter.IsActive())
+            return;
+
+        std::unique_lock<std::mutex> lock = lock_log();
+        if (!filter_index.matches(Filter.InputBuf))
+        {
+            stop_filter_thread(lock);
+            filter_index.reset(Filter.InputBuf, Items);
+        }
+
+        if (filter_busy)
+            return;
+
+        /* thread_filter does not touch mutex_log after clearing filter_busy */
+        if (thread_filter.joinable())
+            thread_filter.join();
+
+        filter_index.prune(Items);
+        if (Items.items_end - SDL_max(filter_index.scan_end, Items.items_first) <= LOG_FILTER_SYNC_ITEMS)
+        {
+            filter_index.extend(Items, Items.items_end);
+            return;
+        }
+
+        filter_busy = true;
+        thread_filter = std::thread([this]() {
+            std::unique_lock<std::mutex> lock_thread = lock_log();
+            while (!filter_stop && filter_index.scan_end < Items.items_end)
+            {
+                filter_index.extend(Items, filter_index.scan_end + LOG_FILTER_SLICE_ITEMS);
+                lock_thread.unlock();
+                std::this_thread::yield();
+                lock_thread.lock();
+            }
+            filter_busy = false;
+        });
+    }
+
+    /** Searches Items for search.query, this thread and all search* members are protected by mutex_log */
+    std::thread thread_search;
+    std::condition_variable cond_search;
+    bool search_stop = false;
+    log_search_t search;
+
+    /** Search UI state */
+    bool search_shown = false;
+    char search_buf[256] = "";
+    bool search_regex = false;
+    int search_level = 0;
+    char search_file[128] = "";
+    char search_func[128] = "";
+
+    /** Absolute index of the item selected with next/previous, or UINT64_MAX */
+    Uint64 search_cur = UINT64_MAX;
+    bool search_scroll_pending = false;
+
+    void stop_search_thread()
+    {
+        {
+            std::unique_lock<std::mutex> lock = lock_log();
+            search_stop = true;
+        }
+        cond_search.notify_all();
+        if (thread_search.joinable())
+            thread_search.join();
+    }
 
-        char* lstart = buf;
-        char* lend = buf;
-        for (char* i = buf; *i != '\0'; i++)
+    /**
+     * Body of thread_search
+     *
+     * Items are copied out of the store in batches of up to LOG_SEARCH_BATCH_ITEMS items, so that mutex_log is only held
+     * for a memcpy, and a slow regex never blocks the loggers
+     */
+    void search_thread_main()
+    {
+        struct batch_item_t
         {
-            if (*i != '\n')
+            Uint64 item;
+            int lvl;
+            const char* fname;
+            const char* func;
+            size_t str_offset;
+            size_t str_len;
+        };
+
+        log_search_matcher_t matcher;
+        Uint64 matcher_generation = 0;
+        bool matcher_ok = false;
+        std::vector<batch_item_t> batch;
+        std::vector<char> batch_text;
+        std::vector<Uint64> found;
+
+        std::unique_lock<std::mutex> lock = lock_log();
+        while (!search_stop)
+        {
+            search.prune(Items);
+            if (!search.active() || search.done(Items) || (matcher_generation == search.generation && !matcher_ok))
+            {
+                cond_search.wait(lock);
+                continue;
+            }
+
+            const Uint64 generation = search.generation;
+            if (matcher_generation != generation)
+            {
+                log_search_t::query_t query = search.query;
+                std::string error;
+                lock.unlock();
+                matcher_ok = matcher.compile(query, error);
+                lock.lock();
+                matcher_generation = generation;
+                if (generation == search.generation)
+                    search.error = error;
                 continue;
-            lend = i;
-            float len = SDL_utf8strnlen(lstart, lend - lstart);
-            if (len > l.line_width)
-                l.line_width = len;
-            lstart = i;
-            l.num_lines++;
+            }
+
+            const Uint64 begin = SDL_max(search.scan_end, Items.items_first);
+            Uint64 end = begin;
+            batch.clear();
+            batch_text.clear();
+            for (; end < Items.items_end && end - begin < LOG_SEARCH_BATCH_ITEMS && batch_text.size() < LOG_SEARCH_BATCH_BYTES; end++)
+            {
+                const log_item_t& l = Items.at_absolute(end);
+                batch_item_t b;
+                b.item = end;
+                b.lvl = l.lvl;
+                b.fname = l.str_fname;
+                b.func = l.str_func;
+                b.str_offset = batch_text.size();
+                b.str_len = strlen(l.str);
+                batch_text.insert(batch_text.end(), l.str, l.str + b.str_len);
+                batch.push_back(b);
+            }
+            lock.unlock();
+
+            found.clear();
+            for (const batch_item_t& b : batch)
+                if (matcher.matches(b.lvl, b.fname, b.func, batch_text.data() + b.str_offset, b.str_len))
+                    found.push_back(b.item);
+
+            lock.lock();
+            if (generation != search.generation)
+                continue;
+            search.matches.insert(search.matches.end(), found.begin(), found.end());
+            search.scan_end = end;
+        }
+    }
+
+    /**
+     * Restart the search if the query in the UI changed, and wake thread_search if there are new items to search
+     */
+    void update_search()
+    {
+        static const int levels[] = { INT_MAX, dev_console::LEVEL_FATAL, dev_console::LEVEL_ERROR, dev_console::LEVEL_WARN, dev_console::LEVEL_INFO,
+            dev_console::LEVEL_TRACE };
+
+        log_search_t::query_t query;
+        query.text = search_buf;
+        query.regex = search_regex;
+        query.max_lvl = levels[SDL_clamp(search_level, 0, int(IM_ARRAYSIZE(levels)) - 1)];
+        query.file_glob = search_file;
+        query.func_glob = search_func;
+
+        std::unique_lock<std::mutex> lock = lock_log();
+        if (query != search.query)
+        {
+            search.reset(query, Items);
+            search_cur = UINT64_MAX;
+        }
+
+        if (!search.active() || search.done(Items))
+            return;
+
+        if (!thread_search.joinable())
+        {
+            search_stop = false;
+            thread_search = std::thread([this]() { search_thread_main(); });
         }
+        cond_search.notify_one();
+    }
 
-        float len = SDL_utf8strnlen(lstart, lend - lstart);
-        if (len > l.line_width)
-            l.line_width = len;
+    /**
+     * Select the next or previous match, wrapping around at either end
+     */
+    void search_navigate(bool forward)
+    {
+        std::unique_lock<std::mutex> lock = lock_log();
+        search.prune(Items);
+        if (!search.size())
+            return;
 
-        l.line_width *= dev_console::add_log_font_width;
+        size_t i;
+        if (search_cur == UINT64_MAX || search_cur < Items.items_first)
+            i = forward ? 0 : search.size() - 1;
+        else if (forward)
+        {
+            i = search.lower_bound(search_cur + 1);
+            if (i == search.size())
+                i = 0;
+        }
+        else
+        {
+            i = search.lower_bound(search_cur);
+            i = (i == 0) ? search.size() - 1 : i - 1;
+        }
 
-        if (l.num_lines == 0)
-            l.num_lines = 1;
+        search_cur = search.match(i);
+        search_scroll_pending = true;
+    }
 
-        if (!quiet)
+    /**
+     * Draw the search bar
+     */
+    void draw_search()
+    {
+        bool go_next = false;
+        ImGui::SetNextItemWidth(220);
+        if (ImGui::InputTextWithHint("##search", "Search", search_buf, IM_ARRAYSIZE(search_buf), ImGuiInputTextFlags_EnterReturnsTrue))
         {
-            size_t buf_len = strlen(buf);
-            if (buf_len > 0 && buf[buf_len - 1] == '\n')
-                printf("%s", buf);
-            else
-                printf("%s\n", buf);
+            go_next = true;
+            ImGui::SetKeyboardFocusHere(-1);
         }
+        ImGui::SameLine();
+        ImGui::Checkbox("Regex", &search_regex);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(80);
+        ImGui::Combo("##search_level", &search_level, "Any\0Fatal\0Error\0Warn\0Info\0Trace\0");
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(100);
+        ImGui::InputTextWithHint("##search_file", "File glob", search_file, IM_ARRAYSIZE(search_file));
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(100);
+        ImGui::InputTextWithHint("##search_func", "Function glob", search_func, IM_ARRAYSIZE(search_func));
+        ImGui::SameLine();
+        bool go_prev = ImGui::ArrowButton("##search_prev", ImGuiDir_Up);
+        ImGui::SameLine();
+        go_next |= ImGui::ArrowButton("##search_next", ImGuiDir_Down);
 
-        std::lock_guard<std::mutex> lock(mutex_log);
-        Items.push_back(l);
+        update_search();
+        if (go_prev || go_next)
+            search_navigate(go_next);
 
-        if (Items.Size > ITEM_COUNT_SHRINK_AT)
+        ImGui::SameLine();
+        std::unique_lock<std::mutex> lock = lock_log();
+        search.prune(Items);
+        if (!search.error.empty())
+            ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", search.error.c_str());
+        else if (search.active())
         {
-            for (int i = 0; i < ITEM_COUNT_SHRINK_AMOUNT; i++)
-                free(Items[i].str);
+            size_t cur = 0;
+            if (search_cur != UINT64_MAX && search_cur >= Items.items_first)
+            {
+                cur = search.lower_bound(search_cur);
+                cur = (cur < search.size() && search.match(cur) == search_cur) ? cur + 1 : 0;
+            }
+            ImGui::Text("%zu/%zu matches%s", cur, search.size(), search.done(Items) ? "" : " (searching...)");
+        }
+    }
+
+    /** Writes the log to a file or the clipboard, all export_* members are protected by mutex_log */
+    std::thread thread_export;
+    bool export_busy = false;
+    bool export_stop = false;
+
+    /** Text for the clipboard, set by thread_export for the main thread to pick up in poll_export() */
+    std::string export_clipboard;
+    bool export_clipboard_ready = false;
 
-            memmove(Items.Data, Items.Data + ITEM_COUNT_SHRINK_AMOUNT, (Items.Size - ITEM_COUNT_SHRINK_AMOUNT) * sizeof(Items[0]));
-            Items.resize(Items.Size - ITEM_COUNT_SHRINK_AMOUNT);
+    /** Export UI state */
+    char export_path[256] = "console_export.txt";
+    int export_level = 0;
+
+    void stop_export_thread()
+    {
+        {
+            std::unique_lock<std::mutex> lock = lock_log();
+            export_stop = true;
         }
+        if (thread_export.joinable())
+            thread_export.join();
     }
 
-    void AddLog(const char* fmt, ...) IM_FMTARGS(2)
+    /**
+     * Start writing every item that passes filter_text and is at or below max_lvl to a PhysFS file or the clipboard
+     *
+     * Items are formatted in chunks of LOG_EXPORT_CHUNK_SIZE bytes by thread_export, so mutex_log is only held while
+     * formatting a single chunk, and nothing is done during rendering
+     *
+     * @param path PhysFS path to write to, or NULL for the clipboard
+     * @param filter_text Text for an ImGuiTextFilter
+     * @param max_lvl Only export items at or below this level, INT_MAX to export every item
+     *
+     * @returns True if the export was started
+     */
+    bool start_export(const char* path, const char* filter_text, int max_lvl)
     {
-        char buf[VA_BUF_LEN];
-        decode_variadic_to_buffer(buf, fmt);
+        std::unique_lock<std::mutex> lock = lock_log();
+        if (export_busy)
+        {
+            lock.unlock();
+            dc_log_error("An export is already in progress");
+            return false;
+        }
+        lock.unlock();
 
-        log_item_t l;
-        l.time = SDL_GetTicks();
-        l.str = Strdup(buf);
-        l.str_fname = __FILE_NAME__;
-        l.str_func = "";
-        l.line = -1;
+        /* Creating the file can take a while, so it is done without mutex_log held */
+        PHYSFS_File* fd = NULL;
+        if (path && !(fd = PHYSFS_openWrite(path)))
+        {
+            dc_log_error("Unable to open \"%s\": %s", path, PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+            return false;
+        }
+
+        lock.lock();
+        if (export_busy)
+        {
+            lock.unlock();
+            if (fd)
+                PHYSFS_close(fd);
+            dc_log_error("An export is already in progress");
+            return false;
+        }
+
+        /* Joining is safe as thread_export does not touch mutex_log after clearing export_busy */
+        if (thread_export.joinable())
+            thread_export.join();
+
+        export_busy = true;
+        export_stop = false;
+        std::string dest = path ? path : "the clipboard";
+        std::string filter_str = filter_text;
+        thread_export = std::thread([this, fd, dest, filter_str, max_lvl]() {
+            ImGuiTextFilter filter(filter_str.c_str());
+            std::string chunk;
+            std::string clipboard;
+            chunk.reserve(LOG_EXPORT_CHUNK_SIZE + VA_BUF_LEN);
+
+            size_t num_items = 0;
+            bool failed = false;
+
+            std::unique_lock<std::mutex> lock_thread = lock_log();
+            Uint64 pos = Items.items_first;
+            const Uint64 end = Items.items_end;
+            const Uint64 init_count = Items.init_count;
+            while (!export_stop && Items.init_count == init_count && pos < end)
+            {
+                chunk.clear();
+                for (pos = SDL_max(pos, Items.items_first); pos < end && chunk.size() < LOG_EXPORT_CHUNK_SIZE; pos++)
+                {
+                    log_item_t& l = Items.at_absolute(pos);
+                    if (max_lvl != INT_MAX && (l.lvl < 0 || l.lvl > max_lvl))
+                        continue;
+                    if (!filter.PassFilter(l.str))
+                        continue;
+
+                    char buf[VA_BUF_LEN];
+                    const char* text = l.display_text(buf, IM_ARRAYSIZE(buf));
+                    size_t len = strlen(text);
+                    chunk.append(text, len);
+                    if (!len || text[len - 1] != '\n')
+                        chunk.push_back('\n');
+                    num_items++;
+                }
+                lock_thread.unlock();
+
+                if (fd)
+                    failed |= PHYSFS_writeBytes(fd, chunk.data(), chunk.size()) != PHYSFS_sint64(chunk.size());
+                else
+                    clipboard.append(chunk);
+
+                lock_thread.lock();
+            }
+            bool aborted = export_stop || Items.init_count != init_count;
+            lock_thread.unlock();
+
+            if (fd && !PHYSFS_close(fd))
+                failed = true;
 
-        if (strstr(buf, "[error]"))
-            l.lvl = dev_console::LEVEL_ERROR;
-        else if (strstr(buf, "[warn]"))
-            l.lvl = dev_console::LEVEL_WARN;
-        else if (strstr(buf, "[trace]"))
-            l.lvl = dev_console::LEVEL_TRACE;
-        else if (strncmp(buf, "# ", 2) == 0)
-            l.lvl = dev_console::LEVEL_INTERNAL_CMD;
-        else
-            l.lvl = dev_console::LEVEL_INTERNAL;
+            if (aborted)
+                dc_log_warn("Export to %s was aborted", dest.c_str());
+            else if (failed)
+                dc_log_error("Unable to write to \"%s\": %s", dest.c_str(), PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+            else
+                dc_log("Exported %zu items to %s", num_items, dest.c_str());
 
-        push_back_log(l, false);
+            lock_thread.lock();
+            if (!fd && !aborted)
+            {
+                export_clipboard.swap(clipboard);
+                export_clipboard_ready = true;
+            }
+            export_busy = false;
+        });
+
+        return true;
     }
 
-    inline void render_item(log_item_t l, float line_height, float line_height_spacing, ImVec4& last_color)
+    /**
+     * Hand a finished clipboard export to ImGui, this must be called from the main thread
+     */
+    void poll_export()
     {
-        ImVec2 rect(l.line_width, line_height * (l.num_lines - 1) + line_height_spacing);
-        if (ImGui::IsRectVisible(rect))
+        std::string text;
         {
-            char buf[VA_BUF_LEN];
+            std::unique_lock<std::mutex> lock = lock_log();
+            if (!export_clipboard_ready)
+                return;
+            export_clipboard_ready = false;
+            text.swap(export_clipboard);
+        }
+        ImGui::SetClipboardText(text.c_str());
+    }
 
-            l.format_str(buf, IM_ARRAYSIZE(buf));
-            l.line_width = ImGui::CalcTextSize(buf).x + ImGui::GetStyle().ItemSpacing.x * 2;
+    /**
+     * Render the rows that intersect the visible region of the current window
+     *
+     * Row positions are derived from a prefix sum of line counts, so the first visible row is found with a binary search
+     * and the rows above and below the visible region are each covered by a single ImGui::Dummy()
+     *
+     * Callers must hold mutex_log
+     *
+     * @param num_rows Number of rows
+     * @param get_item Callable returning the log_item_t& of a row
+     * @param lines_before Callable returning the number of lines before a row, where num_rows is valid and returns the total
+     * @param width Width of the widest row
+     * @param line_height Height of a single line of text
+     * @param item_spacing Vertical spacing between items
+     * @param highlight Item to draw a background behind, may be NULL
+     * @param scroll_to_row Row to center the window on, or SIZE_MAX
+     */
+    template <typename get_item_t, typename lines_before_t>
+    void render_rows_clipped(size_t num_rows, get_item_t get_item, lines_before_t lines_before, float width, float line_height, float item_spacing,
+        ImVec4& last_color, const log_item_t* highlight, size_t scroll_to_row)
+    {
+        if (!num_rows)
+            return;
 
-            ImVec4 new_color = l.get_color();
+        /* Offset of the top of row i from the top of the first row */
+        auto row_y = [&](size_t i) -> float { return lines_before(i) * line_height + i * item_spacing; };
 
-            if (new_color != last_color)
-            {
-                if (last_color.x > -0.5f)
-                    ImGui::PopStyleColor();
-                ImGui::PushStyleColor(ImGuiCol_Text, new_color);
-            }
+        const float start_y = ImGui::GetCursorPosY();
+        if (scroll_to_row < num_rows)
+            ImGui::SetScrollY(start_y + row_y(scroll_to_row) - ImGui::GetWindowHeight() / 2.0f);
 
-            last_color = new_color;
+        const float view_top = ImGui::GetScrollY() - start_y;
+        const float view_bottom = view_top + ImGui::GetWindowHeight();
+        width = SDL_max(width, 1.0f);
 
-            ImGui::TextUnformatted(buf);
+        /* Last row whose top is at or above view_top */
+        size_t lo = 0;
+        size_t hi = num_rows;
+        while (hi - lo > 1)
+        {
+            size_t mid = lo + (hi - lo) / 2;
+            if (row_y(mid) <= view_top)
+                lo = mid;
+            else
+                hi = mid;
         }
-        else
+
+        if (lo > 0)
+            ImGui::Dummy(ImVec2(width, row_y(lo) - item_spacing));
+
+        size_t i = lo;
+        for (; i < num_rows && row_y(i) < view_bottom; i++)
         {
-            rect.y = line_height * l.num_lines;
-            ImGui::Dummy(rect);
+            log_item_t& l = get_item(i);
+            if (&l == highlight)
+            {
+                ImVec2 p = ImGui::GetCursorScreenPos();
+                ImVec2 p_end(p.x + SDL_max(l.line_width, ImGui::GetContentRegionAvail().x), p.y + line_height * l.num_lines);
+                ImGui::GetWindowDrawList()->AddRectFilled(p, p_end, ImGui::GetColorU32(ImGuiCol_TextSelectedBg));
+            }
+            render_item(l, line_height, line_height + item_spacing, last_color, true);
         }
+
+        if (i < num_rows)
+            ImGui::Dummy(ImVec2(width, row_y(num_rows) - row_y(i) - item_spacing));
     }
 
     void Draw(const char* title, bool* p_open)
@@ -545,7 +3736,35 @@ struct AppConsole
             ClearLog();
         }
         ImGui::SameLine();
-        bool copy_to_clipboard = ImGui::Button("Copy");
+        if (ImGui::Button("Copy"))
+            start_export(NULL, Filter.InputBuf, INT_MAX);
+        ImGui::SameLine();
+        if (ImGui::Button("Export"))
+            ImGui::OpenPopup("Export");
+        if (ImGui::BeginPopup("Export"))
+        {
+            ImGui::SetNextItemWidth(200);
+            ImGui::InputText("Path", export_path, IM_ARRAYSIZE(export_path));
+            ImGui::SetNextItemWidth(200);
+            ImGui::Combo("Max level", &export_level, "Any\0Fatal\0Error\0Warn\0Info\0Trace\0");
+            ImGui::TextUnformatted("Items are exported through the current filter");
+            int max_lvl = (export_level > 0) ? export_level - 1 : INT_MAX;
+            if (ImGui::Button("Export to file"))
+            {
+                start_export(export_path, Filter.InputBuf, max_lvl);
+                ImGui::CloseCurrentPopup();
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Copy to clipboard"))
+            {
+                start_export(NULL, Filter.InputBuf, max_lvl);
+                ImGui::CloseCurrentPopup();
+            }
+            ImGui::EndPopup();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Search"))
+            search_shown = !search_shown;
 
         // ImGui::Separator();
         ImGui::SameLine();
@@ -563,7 +3782,19 @@ struct AppConsole
         ImGui::SameLine();
         Filter.Draw("Filter (\"incl,-excl\") (\"error\")", 180);
         ImGui::SameLine();
-        ImGui::Text("| %d entries", Items.Size);
+        update_filter_index();
+        {
+            std::unique_lock<std::mutex> lock = lock_log();
+            if (!Filter.IsActive())
+                ImGui::Text("| %zu entries", Items.size());
+            else
+            {
+                filter_index.prune(Items);
+                ImGui::Text("| %zu/%zu entries%s", filter_index.size(), Items.size(), filter_busy ? " (filtering...)" : "");
+            }
+        }
+        if (search_shown)
+            draw_search();
         ImGui::Separator();
 
         // Reserve enough left-over height for 1 separator + 1 input text
@@ -576,50 +3807,45 @@ struct AppConsole
             ImGui::EndPopup();
         }
 
-        // Display every line as a separate entry so we can cconst char* cmd = command_line;
-        // Change their color or add custom widgets.
-        // If you only want raw text you can use ImGui::TextUnformatted(log.begin(), log.end());
-        // NB- if you have thousands of entries this approach may be too inefficient and may require user-side clipping
-        // to only process visible items. The clipper will automatically measure the height of your first item and then
-        // "seek" to display only items in the visible area.
-        // To use the clipper we can replace your standard loop:
-        //      for (int i = 0; i < Items.Size; i++)
-        //   With:
-        //      ImGuiListClipper clipper;
-        //      clipper.Begin(Items.Size);
-        //      while (clipper.Step())
-        //         for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
-        // - That your items are evenly spaced (same height)
-        // - That you have cheap random access to your elements (you can access them given their index,
-        //   without processing all the ones before)
-        // You cannot this code as-is if a filter is active because it breaks the 'cheap random-access' property.
-        // We would need random-access on the post-filtered list.
-        // A typical application wanting coarse clipping and filtering may want to pre-compute an array of indices
-        // or offsets of items that passed the filtering test, recomputing this array when user changes the filter,
-        // and appending newly elements as they are inserted. This is left as a task to the user until we can manage
-        // to improve this example code!
-        // If your items are of variable height:
-        // - Split them into same height items would be simpler and facilitate random-seeking into your list.
-        // - Consider using manual call to IsRectVisible() and skipping extraneous decoration from your items.
+        // Display every item as a separate entry so we can change their color.
+        // Only the visible items are submitted, see render_rows_clipped()
         ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(4, 1)); // Tighten spacing
-        if (copy_to_clipboard)
-            ImGui::LogToClipboard();
+        bool scrolled_to_match = false;
 
         {
-            std::lock_guard<std::mutex> lock(mutex_log);
+            std::unique_lock<std::mutex> lock = lock_log();
 
             float line_height = ImGui::GetTextLineHeight();
             float line_height_spacing = ImGui::GetTextLineHeightWithSpacing();
 
             ImVec4 last_color(-1, -1, -1, -1);
 
-            for (int i = 0, j = 2; i < Items.Size; i++, j++)
+            const float item_spacing = line_height_spacing - line_height;
+
+            update_width_key();
+
+            const log_item_t* highlight = NULL;
+            if (search_cur >= Items.items_first && search_cur < Items.items_end)
+                highlight = &Items.at_absolute(search_cur);
+
+            if (!Filter.IsActive())
             {
-                const char* item = Items[i].str;
-                if (!Filter.PassFilter(item))
-                    continue;
-                render_item(Items[i], line_height, line_height_spacing, last_color);
+                size_t scroll_to_row = (search_scroll_pending && highlight) ? size_t(search_cur - Items.items_first) : SIZE_MAX;
+                render_rows_clipped(
+                    Items.size(), [&](size_t i) -> log_item_t& { return Items[i]; }, [&](size_t i) { return Items.lines_before(i); },
+                    Items.max_line_width, line_height, item_spacing, last_color, highlight, scroll_to_row);
+            }
+            else
+            {
+                filter_index.prune(Items);
+                size_t scroll_to_row = (search_scroll_pending && highlight) ? filter_index.find(search_cur) : SIZE_MAX;
+                render_rows_clipped(
+                    filter_index.size(), [&](size_t i) -> log_item_t& { return Items.at_absolute(filter_index.item(i)); },
+                    [&](size_t i) { return filter_index.lines_before(i); }, filter_index.max_line_width, line_height, item_spacing, last_color,
+                    highlight, scroll_to_row);
             }
+            scrolled_to_match = search_scroll_pending && highlight;
+            search_scroll_pending = false;
 
             if (last_color.x > -0.5f)
                 ImGui::PopStyleColor();
@@ -627,10 +3853,7 @@ struct AppConsole
             ImGui::Dummy(ImVec2(10, (line_height + line_height_spacing) / 5.0f));
         }
 
-        if (copy_to_clipboard)
-            ImGui::LogFinish();
-
-        if (ScrollToBottom || (AutoScroll && ImGui::GetScrollY() >= ImGui::GetScrollMaxY()))
+        if (ScrollToBottom || (AutoScroll && !scrolled_to_match && ImGui::GetScrollY() >= ImGui::GetScrollMaxY()))
             ImGui::SetScrollHereY(1.0f);
         ScrollToBottom = false;
 
@@ -665,36 +3888,30 @@ struct AppConsole
         ImGui::End();
     }
 
+    /** Items drawn by draw_overlay(), newest first, kept around to avoid allocating every frame */
+    log_item_t* overlay_items[LOG_RECENT_ITEMS];
+
     void draw_overlay(const char* title, dev_console::log_level_t max_lvl)
     {
-        std::vector<int> filter_items;
-        filter_items.reserve(12);
-
-        std::lock_guard<std::mutex> lock(mutex_log);
+        std::lock_guard<std::mutex> lock(recent.mutex);
         Uint64 sdl_tick_cur = SDL_GetTicks();
         int num_lines = 0;
-        for (int i = Items.Size - 1; i >= 0; i--)
-        {
-            Uint64 tdiff = sdl_tick_cur - Items[i].time;
+        int num_items = 0;
+        recent.walk_locked(max_lvl, [&](log_item_t& l) -> bool {
+            Uint64 tdiff = sdl_tick_cur - l.time;
             if (tdiff >= 2500 && (tdiff > 7500 || num_lines >= 8))
-            {
-                i = -1;
-                continue;
-            }
-            if (tdiff < 2500 && (tdiff > 2500 || num_lines >= 12))
-            {
-                i = -1;
-                continue;
-            }
-
-            if (Items[i].lvl < 0 || Items[i].lvl > max_lvl)
-                continue;
-
-            num_lines += Items[i].num_lines;
-            filter_items.push_back(i);
-        }
+                return false;
+            if (tdiff < 2500 && num_lines >= 12)
+                return false;
+            if (num_items == LOG_RECENT_ITEMS)
+                return false;
+
+            num_lines += l.num_lines;
+            overlay_items[num_items++] = &l;
+            return true;
+        });
 
-        if (!filter_items.size())
+        if (!num_items)
             return;
 
         ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f), ImGuiCond_Always);
@@ -730,8 +3947,8 @@ struct AppConsole
 
         ImVec4 last_color(-1, -1, -1, -1);
 
-        for (int i = filter_items.size() - 1; i >= 0; i--)
-            render_item(Items[filter_items[i]], line_height, line_height_spacing, last_color);
+        for (int i = num_items - 1; i >= 0; i--)
+            render_item(*overlay_items[i], line_height, line_height_spacing, last_color, false);
 
         if (last_color.x > -0.5f)
             ImGui::PopStyleColor();
@@ -748,8 +3965,8 @@ struct AppConsole
         auto mit = commands_map.find(commandName);
         if (mit == commands_map.end())
         {
-            commands_vec.push_back(commandName);
-            commands_map.insert(std::make_pair(commandName, func));
+            name_index.add_command(commandName);
+            commands_map.insert(std::make_pair(hashed_name_t(commandName), func));
         }
     }
 
@@ -758,14 +3975,13 @@ struct AppConsole
         auto mit = commands_map.find(commandName);
         if (mit == commands_map.end())
         {
-            commands_vec.push_back(commandName);
-            commands_map.insert(std::make_pair(commandName, [=](const int, const char*[]) -> int { return func(); }));
+            name_index.add_command(commandName);
+            commands_map.insert(std::make_pair(hashed_name_t(commandName), [=](const int, const char*[]) -> int { return func(); }));
         }
     }
 
     void ExecCommand(const char* command_line, bool quiet = false)
     {
-        int errorCode = 0;
         if (!quiet)
             AddLog("# %s\n", command_line);
 
@@ -781,22 +3997,55 @@ struct AppConsole
             }
         History.push_back(Strdup(command_line));
 
-        std::string command_line_str(command_line);
-        // Process command
-        if (Stricmp(command_line, "help") == 0)
+        ExecLine(command_line);
+
+        // On command input, we scroll to bottom even if AutoScroll==false
+        ScrollToBottom = !quiet;
+    }
+
+    /**
+     * Whether command_line is one of the commands that ExecLine() handles itself instead of tokenizing
+     */
+    static bool IsBuiltinLine(const char* command_line)
+    {
+        return IsHelpLine(command_line) || Stricmp(command_line, "history") == 0 || strncmp(command_line, "echo", 4) == 0;
+    }
+
+    /**
+     * Whether command_line is "help" or "help <pattern>"
+     */
+    static bool IsHelpLine(const char* command_line) { return Strnicmp(command_line, "help", 4) == 0 && (command_line[4] == '\0' || command_line[4] == ' '); }
+
+    /**
+     * Runs every command in command_line, without adding it to History
+     */
+    void ExecLine(const char* command_line)
+    {
+        if (IsHelpLine(command_line))
         {
-            AddLog("Commands:");
-            for (int i = 0; i < commands_vec.Size; i++)
-                if (commands_vec[i][0] != '_')
-                    AddLog("- %s", commands_vec[i]);
-            AddLog("Convars:");
-            auto convar_list = convar_t::get_convar_list();
-            for (size_t i = 0; i < convar_list->size(); i++)
+            const char* pattern = command_line + 4;
+            while (*pattern == ' ')
+                pattern++;
+
+            if (*pattern)
+            {
+                /* Best matches first */
+                AddLog("Matches for \"%s\":", pattern);
+                for (const name_index_t::entry_t* e : name_index.fuzzy_find(pattern, strlen(pattern), SIZE_MAX))
+                    AddLog("- %s%s", e->name, e->cvr ? " (Convar)" : "");
+            }
+            else
             {
-                convar_t* cvr = convar_list->at(i);
-                CONVAR_FLAGS cvr_flags = cvr->get_convar_flags();
-                if (!(cvr_flags & CONVAR_FLAG_HIDDEN) && !(!convar_t::dev() && (cvr_flags & CONVAR_FLAG_DEV_ONLY)))
-                    AddLog("- %s", cvr->get_name());
+                AddLog("Commands:");
+                name_index.for_each_prefix("", 0, [&](const name_index_t::entry_t& e) {
+                    if (!e.cvr)
+                        AddLog("- %s", e.name);
+                });
+                AddLog("Convars:");
+                name_index.for_each_prefix("", 0, [&](const name_index_t::entry_t& e) {
+                    if (e.cvr)
+                        AddLog("- %s", e.name);
+                });
             }
         }
         else if (Stricmp(command_line, "history") == 0)
@@ -805,272 +4054,195 @@ struct AppConsole
             for (int i = first > 0 ? first : 0; i < History.Size; i++)
                 AddLog("%3d: %s\n", i, History[i]);
         }
-        else if (command_line_str.rfind("echo", 3) == 0)
+        else if (strncmp(command_line, "echo", 4) == 0)
         {
-            if (command_line_str.size() > 4)
+            if (command_line[4] != '\0')
                 AddLog("%s", &command_line[5]);
             else
                 AddLog("\n");
         }
         else
         {
-            size_t command_cur_pos = 0;
-            size_t command_split_pos = 0;
-            size_t command_line_len = strlen(command_line);
-            do
+            command_tokenizer_t tokens;
+            size_t len = strlen(command_line);
+            while (len)
             {
-                size_t command_discarded_pos = 0;
-                int emc_r = ExecMappedCommand(&command_line[command_cur_pos], command_discarded_pos, command_split_pos, errorCode);
-                command_cur_pos += command_discarded_pos;
-                switch (emc_r)
+                size_t consumed = 0;
+                command_tokenizer_t::result_t result = tokens.tokenize(command_line, len, consumed);
+                switch (result)
                 {
-                case 0:
-                    break;
-                case 1:
-                    if (command_split_pos)
-                        dc_log_error("Unknown command: '%.*s'\n", (int)command_split_pos, &command_line[command_cur_pos]);
-                    else
-                        dc_log_error("Unknown command: '%s'\n", &command_line[command_cur_pos]);
-                    break;
-                case 2:
-                    dc_log_error("Input number of arguments\n");
-                    break;
-                case 4:
-                    dc_log_error("Unterminated quote\n");
+                case command_tokenizer_t::RESULT_OK:
+                    ExecTokenized(tokens.argc, tokens.argv, tokens.raw, tokens.raw_len, convar_t::hash_name(tokens.argv[0]));
                     break;
-                case 5:
-                    dc_log_error("No matching function for convar type\n");
+                case command_tokenizer_t::RESULT_EMPTY:
                     break;
-                default:
-                    dc_log_error("An unknown error %d occurred in ExecMappedCommand", emc_r);
+                case command_tokenizer_t::RESULT_UNTERMINATED_QUOTE:
+                    dc_log_error("Unterminated quote: '%.*s'\n", (int)tokens.raw_len, tokens.raw);
                     break;
                 }
-                if (errorCode != 0)
-                {
-                    if (command_split_pos)
-                        dc_log_error(
-                            "Command: '%.*s' exited with nonzero exit code of %d\n", (int)command_split_pos, &command_line[command_cur_pos], errorCode);
-                    else
-                        dc_log_error("Command: '%s' exited with nonzero exit code of %d\n", &command_line[command_cur_pos], errorCode);
-                }
-                ScrollToBottom = !quiet;
-                command_cur_pos += command_split_pos;
-            } while (command_split_pos != 0 && command_cur_pos <= command_line_len);
+                command_line += consumed;
+                len -= consumed;
+            }
         }
-
-        // On command input, we scroll to bottom even if AutoScroll==false
-        ScrollToBottom = !quiet;
     }
 
-    /*
-     * Parses command_line into argc and argv using custom parser and runs the command if in the
-     * command map
+    /**
+     * Runs a tokenized command and reports any errors
      *
-     * Supports quotes and semicolons
+     * @param raw The command as written, for error messages
+     * @param name_hash convar_t::hash_name() of argv[0]
+     */
+    void ExecTokenized(const int argc, const char** argv, const char* raw, size_t raw_len, Uint32 name_hash)
+    {
+        int errorCode = 0;
+        if (ExecMappedCommand(argc, argv, errorCode, name_hash))
+            dc_log_error("Unknown command: '%.*s'\n", (int)raw_len, raw);
+        else if (errorCode != 0)
+            dc_log_error("Command: '%.*s' exited with nonzero exit code of %d\n", (int)raw_len, raw, errorCode);
+    }
+
+    /** Scripts compiled by the exec command, keyed by PhysFS path */
+    std::unordered_map<std::string, std::shared_ptr<console_script_t>> script_cache;
+
+    /** Nesting depth of exec, to stop scripts that exec themselves */
+    int script_depth = 0;
+
+    /**
+     * Get the compiled form of a script, reading and tokenizing it only if it is not cached or has changed since it was cached
      *
-     * FIXME-OPT: This is an extremely ugly and extremely fragile piece of code that probably contains some sort of vulnerability
+     * @returns NULL if the script could not be read
      */
-    int ExecMappedCommand(const char* command_line, size_t& command_discarded_pos, size_t& command_split_pos, int& errorCode)
+    std::shared_ptr<console_script_t> GetScript(const char* path)
     {
-        size_t CMDL_len = strlen(command_line);
-        if (CMDL_len < 1)
-            return 0;
+        PHYSFS_Stat stat;
+        if (!PHYSFS_stat(path, &stat) || stat.filetype != PHYSFS_FILETYPE_REGULAR)
+            return NULL;
 
-        size_t CMDL_argv_size = 4096;
-        size_t CMDL_overrun_size = 64;
-        size_t argc = 0;
-        char* argv_buffer = (char*)SDL_calloc(CMDL_overrun_size + CMDL_argv_size + CMDL_len, sizeof(char));
-        char** argv = (char**)SDL_calloc(CMDL_overrun_size + CMDL_argv_size, sizeof(char*));
-
-        // dc_log_trace("command_line: \"%s\"\n",command_line);
-        // dc_log_trace("command_line_len: %lu\n",CMDL_len);
-
-        size_t argv_array_i = 0;
-        size_t argv_buffer_pos_start = 0;
-        size_t argv_buffer_pos_cur = 0;
-        char last_char = '\0';
-        char cur_char = '\0';
-        char next_char = '\0';
-        bool in_quote = 0;
-        command_split_pos = 0;
-        // dc_log_trace("command_line: \"%s\"\n",command_line);
-        for (size_t i = 0; i < CMDL_len; i++)
+        std::shared_ptr<console_script_t>& cached = script_cache[path];
+        if (cached && cached->modtime == stat.modtime && cached->filesize == stat.filesize)
+            return cached;
+
+        PHYSFS_File* fd = PHYSFS_openRead(path);
+        if (!fd)
+            return NULL;
+
+        std::shared_ptr<console_script_t> script = std::make_shared<console_script_t>();
+        script->modtime = stat.modtime;
+        script->filesize = stat.filesize;
+
+        Sint64 fd_len = PHYSFS_fileLength(fd);
+        if (fd_len > 0)
         {
-#ifdef DEBUG_EXEC_MAPPED_COMMAND
-#define switchf_c(char_case)                                                                                                                            \
-    dc_log_trace("case     \'%c\': last_char=\'%c\' cur_char=\'%c\' in_quote=\'%d\' i=%02ld argv_buffer_pos_cur=%02ld argv_array_i=%02ld\n", char_case, \
-        last_char, cur_char, in_quote, i, argv_buffer_pos_cur, argv_array_i)
-#define switchf_d()                                                                                                                                            \
-    dc_log_trace("case default: last_char=\'%c\' cur_char=\'%c\' in_quote=\'%d\' i=%02ld argv_buffer_pos_cur=%02ld argv_array_i=%02ld\n", last_char, cur_char, \
-        in_quote, i, argv_buffer_pos_cur, argv_array_i)
-#else
-#define switchf_c(char_case)
-#define switchf_d(char_case)
-#endif
-#define switch_default_op()                            \
-    do                                                 \
-    {                                                  \
-        argv_buffer[argv_buffer_pos_cur++] = cur_char; \
-        last_char = cur_char;                          \
-    } while (0)
+            script->source.resize(fd_len);
+            Sint64 bytes_read = PHYSFS_readBytes(fd, &script->source[0], script->source.size());
+            script->source.resize(SDL_max(bytes_read, Sint64(0)));
+        }
+        PHYSFS_close(fd);
+
+        for (char& c : script->source)
+            if (c == '\n' || c == '\r')
+                c = '\0';
+
+        /* argv holds offsets into strings until strings is complete */
+        std::vector<size_t> arg_offsets;
+        command_tokenizer_t tokens;
+        const char* source = script->source.c_str();
+        size_t source_len = script->source.length();
+        int line_num = 0;
+        for (size_t line_pos = 0; line_pos < source_len; line_pos += strlen(source + line_pos) + 1)
+        {
+            line_num++;
+            const char* line = source + line_pos;
+            while (*line == ' ' || *line == '\t')
+                line++;
 
-            if (argv_array_i > 4096)
-                return 2;
-            cur_char = command_line[i];
-            if (i < (CMDL_len - 1))
-                next_char = command_line[i];
-            else
-                next_char = '\0';
-            switch (cur_char)
-            {
-            case ';':
-                switchf_c(';');
-                if (in_quote)
-                    switch_default_op();
-                else if (argv_buffer_pos_cur == 0)
-                {
-                    command_discarded_pos++;
-                    dc_log_trace("Semicolon at start of buffer, discarding...");
-                }
-                else
-                {
-                    // Crude way of splitting commands
-                    command_split_pos = i;
-                    i = CMDL_len - 1;
-                    dc_log_trace("Semicolon outside of quote, parsing stopped, executing command");
-                }
-                break;
-            case '\0':
-                break;
-            case '"':
-                switchf_c('"');
-                if (last_char != '\\')
-                {
-                    in_quote = !in_quote;
-                }
-                else
-                {
-                    if (argv_buffer_pos_cur > 0)
-                    {
-                        argv_buffer_pos_cur--;
-                        // argv_buffer[argv_buffer_pos_cur++] = '\0';
-                    }
-                    switch_default_op();
-                }
-                break;
-            case '\'':
-                switchf_c('\'');
-                argv_buffer[argv_buffer_pos_cur] = cur_char;
-                last_char = cur_char;
-                break;
-            case ' ':
-                switchf_c(' ');
-                if (argv_buffer_pos_cur == 0)
-                {
-                    command_discarded_pos++;
-                    dc_log_trace("Space at start of buffer discarding");
-                }
-                else if (!in_quote)
+            if (*line == '\0' || *line == '#')
+                continue;
+
+            if (IsBuiltinLine(line))
+            {
+                script->commands.push_back({ -1, 0, size_t(line - source), strlen(line), 0 });
+                continue;
+            }
+
+            size_t len = strlen(line);
+            while (len)
+            {
+                size_t consumed = 0;
+                command_tokenizer_t::result_t result = tokens.tokenize(line, len, consumed);
+                if (result == command_tokenizer_t::RESULT_UNTERMINATED_QUOTE)
+                    dc_log_error("%s:%d: Unterminated quote: '%.*s'", path, line_num, (int)tokens.raw_len, tokens.raw);
+                else if (result == command_tokenizer_t::RESULT_OK)
                 {
-                    if (last_char == ' ') /*argv_buffer_pos_cur = argv_buffer_pos_cur - 1*/
-                        ;
-                    else if (last_char != '\0' || last_char != ' ' || next_char != '\0')
+                    script->commands.push_back(
+                        { int(arg_offsets.size()), tokens.argc, size_t(tokens.raw - source), tokens.raw_len, convar_t::hash_name(tokens.argv[0]) });
+                    for (int i = 0; i < tokens.argc; i++)
                     {
-                        // argv_buffer[argv_buffer_pos_cur++] = '\0';
-                        argv[argv_array_i++] = &argv_buffer[argv_buffer_pos_start];
-                        argv_buffer_pos_start = ++argv_buffer_pos_cur;
-                        // AddLog("%d: %s",__LINE__,argv[argv_array_i-1]);
-                        cur_char = '\0';
+                        arg_offsets.push_back(script->strings.size());
+                        script->strings.append(tokens.argv[i], strlen(tokens.argv[i]) + 1);
                     }
-                    last_char = ' ';
-                }
-                else
-                {
-                    switch_default_op();
+                    arg_offsets.push_back(SIZE_MAX);
                 }
-                break;
-            default:
-                switchf_d();
-                // if(last_char == '\\' && cur_char == '\\')
-                switch_default_op();
-                break;
+                line += consumed;
+                len -= consumed;
             }
         }
-        argv[argv_array_i] = &argv_buffer[argv_buffer_pos_start];
-        if (in_quote)
-            return 4;
-        argc = argv_array_i + 1;
 
-#ifdef DEBUG_EXEC_MAPPED_COMMAND
-        dc_log_trace("Parsing loop done, argc=%lu", argc);
-        for (size_t i = 0; i < argc; i++)
-        {
-            dc_log_trace("argv[%ld]=%p\n", i, (void*)argv[i]);
-            if (argv[i] != NULL)
-                dc_log_trace("argv[%ld]=\"%s\"\n", i, argv[i]);
-        }
+        script->argv.resize(arg_offsets.size());
+        for (size_t i = 0; i < arg_offsets.size(); i++)
+            script->argv[i] = (arg_offsets[i] == SIZE_MAX) ? NULL : script->strings.c_str() + arg_offsets[i];
+
+        cached = script;
+        return script;
+    }
 
-        dc_log_trace("BEGIN argv_buffer_dump\n");
-        for (size_t i = 0; i < CMDL_overrun_size + CMDL_argv_size + CMDL_len; i++)
+    /**
+     * Runs a compiled script, without adding anything to History
+     */
+    void ExecScript(const console_script_t& script)
+    {
+        const char* source = script.source.c_str();
+        for (const console_script_t::command_t& cmd : script.commands)
         {
-            char c = argv_buffer[i];
-            if (c != '\\' && (32 <= c && c <= 126))
-                putc(c, stderr);
-            switch (c)
-            {
-            case '\0':
-                fprintf(stderr, "\\0");
-                break;
-            case '\\':
-                fprintf(stderr, "\\");
-                break;
-            default:
-                break;
-            }
+            if (cmd.argv_first < 0)
+                ExecLine(source + cmd.raw_pos);
+            else
+                ExecTokenized(cmd.argc, (const char**)&script.argv[cmd.argv_first], source + cmd.raw_pos, cmd.raw_len, cmd.name_hash);
         }
-        fprintf(stderr, "\n");
-        fflush_unlocked(stderr);
-        dc_log_trace("END   argv_buffer_dump\n");
+    }
+
+    /**
+     * Runs the command or convar named by argv[0]
+     *
+     * @param errorCode Set to the return value of the command
+     * @param name_hash convar_t::hash_name() of argv[0]
+     *
+     * @returns 0 if the command was found, 1 if it was not
+     */
+    int ExecMappedCommand(const int argc, const char** argv, int& errorCode, Uint32 name_hash)
+    {
+        errorCode = 0;
 
-        dc_log_trace("Command to execute: \"%s\"\n", argv[0]);
+#ifdef DEBUG_EXEC_MAPPED_COMMAND
+        for (int i = 0; i < argc; i++)
+            dc_log_trace("argv[%d]=\"%s\"", i, argv[i]);
 #endif
 
-        int r = 1;
-        if (argv[0] != NULL)
+        auto mit = commands_map.find(hashed_name_t(argv[0], name_hash));
+        if (mit != commands_map.end())
         {
-            std::string stringy((const char*)argv[0]);
+            errorCode = mit->second(argc, argv);
+            return 0;
+        }
 
-            if (argc == 1 && argv[0][0] == '\0')
-            {
-#ifdef DEBUG_EXEC_MAPPED_COMMAND
-                dc_log_trace("Empty command, skipping");
-#endif
-                errorCode = 0;
-                r = 0;
-            }
-            else
-            {
-                auto mit = commands_map.find(stringy);
-                if (mit != commands_map.end())
-                {
-                    errorCode = mit->second(argc, (const char**)argv);
-                    r = 0;
-                }
-                else
-                {
-                    convar_t* cvr = convar_t::get_convar(argv[0]);
-                    if (cvr)
-                    {
-                        errorCode = cvr->convar_command(argc, (const char**)argv);
-                        r = 0;
-                    }
-                }
-            }
+        convar_t* cvr = convar_t::get_convar(argv[0], name_hash);
+        if (cvr)
+        {
+            errorCode = cvr->convar_command(argc, argv);
+            return 0;
         }
 
-        SDL_free(argv_buffer);
-        SDL_free(argv);
-        return r;
+        return 1;
     }
 
     // In C++11 you'd be better off using lambdas for this sort of forwarding callbacks
@@ -1108,29 +4280,20 @@ struct AppConsole
 
             // Build a list of candidates
             ImVector<const char*> candidates;
-            for (int i = 0; i < commands_vec.Size; i++)
-            {
-                if (commands_vec[i][0] == '_' && word_start[0] != '_')
-                    continue;
-                if (Strnicmp(commands_vec[i], word_start, (int)(word_end - word_start)) == 0)
-                    candidates.push_back(commands_vec[i]);
-            }
-
-            auto convar_list = convar_t::get_convar_list();
-            for (size_t i = 0; i < convar_list->size(); i++)
-            {
-                convar_t* cvr = convar_list->at(i);
-                CONVAR_FLAGS cvr_flags = cvr->get_convar_flags();
-                if ((cvr_flags & CONVAR_FLAG_HIDDEN) || (!convar_t::dev() && (cvr_flags & CONVAR_FLAG_DEV_ONLY)))
-                    continue;
-                if (Strnicmp(cvr->get_name(), word_start, (int)(word_end - word_start)) == 0)
-                    candidates.push_back(cvr->get_name());
-            }
+            name_index.for_each_prefix(word_start, word_end - word_start, [&](const name_index_t::entry_t& e) { candidates.push_back(e.name); });
 
             if (candidates.Size == 0)
             {
                 // No match
                 AddLog("No match for \"%.*s\"!\n", (int)(word_end - word_start), word_start);
+
+                std::vector<const name_index_t::entry_t*> closest = name_index.fuzzy_find(word_start, word_end - word_start, 8);
+                if (closest.size())
+                {
+                    AddLogQuiet("Closest matches:\n");
+                    for (const name_index_t::entry_t* e : closest)
+                        AddLogQuiet("- %s\n", e->name);
+                }
             }
             else if (candidates.Size == 1)
             {
@@ -1143,20 +4306,12 @@ struct AppConsole
             {
                 // Multiple matches. Complete as much as we can..
                 // So inputing "C"+Tab will complete to "CL" then display "CLEAR" and "CLASSIFY" as matches.
+                // The candidates are sorted, so the prefix common to all of them is the prefix common to the first and last
+                const char* first = candidates[0];
+                const char* last = candidates[candidates.Size - 1];
                 int match_len = (int)(word_end - word_start);
-                for (;;)
-                {
-                    int c = 0;
-                    bool all_candidates_matches = true;
-                    for (int i = 0; i < candidates.Size && all_candidates_matches; i++)
-                        if (i == 0)
-                            c = toupper(candidates[i][match_len]);
-                        else if (c == 0 || c != toupper(candidates[i][match_len]))
-                            all_candidates_matches = false;
-                    if (!all_candidates_matches)
-                        break;
+                while (first[match_len] && toupper(first[match_len]) == toupper(last[match_len]))
                     match_len++;
-                }
 
                 if (match_len > 0)
                 {
@@ -1216,6 +4371,8 @@ struct AppConsole
 
 static AppConsole _devConsole;
 
+static void stop_log_sink() { _devConsole.stop_sink(); }
+
 bool dev_console::shown = false;
 
 void dev_console::show_hide()
@@ -1228,6 +4385,9 @@ static convar_int_t console_fullscreen("console_fullscreen", false, false, true,
 
 void dev_console::render()
 {
+    _devConsole.drain_log();
+    _devConsole.poll_export();
+
     if (shown)
     {
         _devConsole.console_fullscreen_bool = console_fullscreen.get();
@@ -1273,6 +4433,23 @@ static gui_register_overlay reg_console_overlay(draw_console_overlay);
 void dev_console::add_command(const char* name, std::function<int(const int, const char**)> func) { _devConsole.AddCommand(name, func); }
 void dev_console::add_command(const char* name, std::function<int()> func) { _devConsole.AddCommand(name, func); }
 
+static std::atomic<bool> log_deferred { true };
+static convar_int_t console_log_deferred("console_log_deferred", 1, 0, 1,
+    "Format log messages from the dc_log macros when they are moved to the console instead of on the calling thread", CONVAR_FLAG_INT_IS_BOOL,
+    []() { log_deferred.store(console_log_deferred.get(), std::memory_order_relaxed); });
+
+void dev_console::flush_log()
+{
+    /* util::die() can be reached from static constructors and destructors, before or after _devConsole exists */
+    if (console_constructed.load(std::memory_order_acquire))
+        _devConsole.flush_log();
+}
+
+bool dev_console::try_flush_log() { return console_constructed.load(std::memory_order_acquire) && _devConsole.flush_log(false); }
+void dev_console::start_log_sink() { _devConsole.start_sink(); }
+void dev_console::open_log_file() { _devConsole.open_log_file(); }
+void dev_console::close_log_file() { _devConsole.close_log_file(); }
+
 void dev_console::run_command(const char* fmt, ...)
 {
     char buf[MAX_INPUT_LENGTH];
@@ -1280,14 +4457,36 @@ void dev_console::run_command(const char* fmt, ...)
     _devConsole.ExecCommand(buf, true);
 }
 
+void dev_console::run_command_async(const char* fmt, ...)
+{
+    char buf[MAX_INPUT_LENGTH];
+    decode_variadic_to_buffer(buf, fmt);
+    std::string command(buf);
+    tetra::post_to_main([command]() { _devConsole.ExecCommand(command.c_str(), true); });
+}
+
+std::atomic<int> dev_console::log_level { dev_console::LEVEL_TRACE };
+static convar_int_t log_level_cvr("log_level", dev_console::LEVEL_TRACE, dev_console::LEVEL_FATAL, dev_console::LEVEL_TRACE,
+    "Least severe log level to print [0: Fatal, 1: Error, 2: Warn, 3: Info, 4: Trace]", 0,
+    []() {
+        dev_console::log_level.store(log_level_cvr.get(), std::memory_order_relaxed);
+        get_log_callsites().refresh();
+    });
+
 void dev_console::add_log(dev_console::log_level_t lvl, const char* fname, const char* func, int line, const char* fmt, ...)
 {
+    if (lvl > log_level.load(std::memory_order_relaxed))
+        return;
+
     char buf[VA_BUF_LEN];
     decode_variadic_to_buffer(buf, fmt);
 
     log_item_t l;
     l.time = SDL_GetTicks();
-    l.str = _devConsole.Strdup(buf);
+    l.repeat = 1;
+    l.suppressed = 0;
+    l.str = buf;
+    l.fmt = NULL;
     l.lvl = lvl;
     l.str_fname = fname;
     l.str_func = func;
@@ -1295,3 +4494,74 @@ void dev_console::add_log(dev_console::log_level_t lvl, const char* fname, const
 
     _devConsole.push_back_log(l, false);
 }
+
+static std::atomic<int> log_rate_limit;
+static std::atomic<int> log_rate_burst { 10 };
+static convar_int_t log_rate_limit_cvr("log_rate_limit", 0, 0, 100000, "Maximum sustained log messages per second from a single callsite (0 to disable)", 0,
+    []() { log_rate_limit.store(log_rate_limit_cvr.get(), std::memory_order_relaxed); });
+static convar_int_t log_rate_burst_cvr("log_rate_burst", 10, 1, 100000,
+    "Number of log messages a callsite may send in a burst before log_rate_limit applies", 0,
+    []() { log_rate_burst.store(log_rate_burst_cvr.get(), std::memory_order_relaxed); });
+
+/**
+ * Token bucket rate limiter for a callsite, kept as the time at which the bucket will be full again
+ *
+ * @returns true if the message should be dropped
+ */
+static bool rate_limit_callsite(dev_console::log_callsite_t* site, int rate)
+{
+    Uint64 now = SDL_GetTicksNS();
+    Uint64 cost = SDL_NS_PER_SECOND / rate;
+    Uint64 capacity = cost * log_rate_burst.load(std::memory_order_relaxed);
+
+    unsigned long long full_time = site->rate_full_time.load(std::memory_order_relaxed);
+    unsigned long long new_full_time;
+    do
+    {
+        Uint64 base = SDL_max(Uint64(full_time), now);
+        if (base + cost - now > capacity)
+            return true;
+        new_full_time = base + cost;
+    } while (!site->rate_full_time.compare_exchange_weak(full_time, new_full_time, std::memory_order_relaxed));
+
+    return false;
+}
+
+void dev_console::add_log_argv(dev_console::log_callsite_t* site, const char* func, const char* fmt, const dev_console::log_arg_t* args, int num_args)
+{
+    int rate = log_rate_limit.load(std::memory_order_relaxed);
+    if (rate > 0 && rate_limit_callsite(site, rate))
+    {
+        site->rate_suppressed.fetch_add(1, std::memory_order_relaxed);
+        log_stats.rate_limited.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    char payload[VA_BUF_LEN];
+    size_t payload_len = log_format::capture(payload, IM_ARRAYSIZE(payload) - 1, fmt, args, num_args);
+
+    log_item_t l;
+    l.time = SDL_GetTicks();
+    l.repeat = 1;
+    l.suppressed = site->rate_suppressed.load(std::memory_order_relaxed) ? site->rate_suppressed.exchange(0, std::memory_order_relaxed) : 0;
+    l.lvl = site->lvl;
+    l.str_fname = site->fname;
+    l.str_func = func;
+    l.line = site->line;
+
+    if (log_deferred.load(std::memory_order_relaxed))
+    {
+        payload[payload_len] = '\0';
+        l.str = payload;
+        l.fmt = fmt;
+        l.quiet = false;
+        _devConsole.enqueue_log(l, payload_len);
+        return;
+    }
+
+    char buf[VA_BUF_LEN];
+    log_format::format(buf, IM_ARRAYSIZE(buf), fmt, payload, payload_len);
+    l.str = buf;
+    l.fmt = NULL;
+    _devConsole.push_back_log(l, false);
+}
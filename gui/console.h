@@ -75,11 +75,36 @@ void show_hide();
  */
 void render();
 
+/**
+ * Start the thread that writes log messages to stdout every console_log_flush_ms milliseconds
+ *
+ * Messages logged before this are held in memory until the first flush, this is called by tetra::init()
+ */
+void start_log_sink();
+
+/**
+ * Start writing log records to files in the PhysFS write dir (Controlled by the convar console_log_file)
+ *
+ * Records logged before this are held in memory and written to the first file
+ *
+ * This should be called once the PhysFS write dir has been set
+ */
+void open_log_file();
+
+/**
+ * Write out pending log records and close the current log file, waiting for any export started by log_export to finish
+ *
+ * This must be called before PHYSFS_deinit()
+ */
+void close_log_file();
+
 /**
  * Register a command with the console
  *
  * This function should only be called from the event thread
  *
+ * name is not copied and must remain valid for as long as the console exists
+ *
  * WARNING: This function is not safe to call from multiple threads
  */
 void add_command(const char* name, std::function<int(const int, const char**)> func);
@@ -89,6 +114,8 @@ void add_command(const char* name, std::function<int(const int, const char**)> f
  *
  * This function should only be called from the event thread
  *
+ * name is not copied and must remain valid for as long as the console exists
+ *
  * WARNING: This function is not safe to call from multiple threads
  */
 void add_command(const char* name, std::function<int()> func);
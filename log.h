@@ -37,6 +37,19 @@
 #define STBSP__ATTRIBUTE_FORMAT(fmt, va)
 #endif
 
+#include <atomic>
+#include <stddef.h>
+#include <type_traits>
+
+/**
+ * Least severe log level compiled in, dc_log macros for less severe levels expand to nothing and do not evaluate their arguments
+ *
+ * [0: Fatal, 1: Error, 2: Warn, 3: Info, 4: Trace], set with the CMake option TETRA_LOG_MIN_LEVEL
+ */
+#ifndef TETRA_LOG_MIN_LEVEL
+#define TETRA_LOG_MIN_LEVEL 4
+#endif
+
 namespace dev_console
 {
 enum log_level_t
@@ -50,6 +63,13 @@ enum log_level_t
     LEVEL_TRACE,
 };
 
+/**
+ * Least severe log level that is printed, messages for less severe levels are dropped before they are formatted
+ *
+ * Mirrors the convar log_level, the dc_log macros instead read the cached state of their callsite (See: log_callsite_t)
+ */
+extern std::atomic<int> log_level;
+
 /**
  * Print a log message to the console
  *
@@ -59,6 +79,8 @@ enum log_level_t
  *
  * Safe to call from any thread
  *
+ * Messages are pushed onto a lock-free queue which is moved to the console by dev_console::render() or the stdout sink thread
+ *
  * @param lvl Log level, a level of LEVEL_INTERNAL disables fname, func, and line
  * @param fname File the log call was made from
  * @param func Function the log call was made from
@@ -72,6 +94,171 @@ enum log_level_t
  */
 void add_log(log_level_t lvl, const char* fname, const char* func, int line, const char* fmt, ...) STBSP__ATTRIBUTE_FORMAT(5, 6);
 
+/**
+ * Argument to a deferred log message
+ *
+ * @sa add_log_argv
+ */
+struct log_arg_t
+{
+    enum type_t : unsigned char
+    {
+        TYPE_INT,
+        TYPE_UINT,
+        TYPE_DOUBLE,
+        TYPE_PTR,
+    } type;
+
+    union
+    {
+        long long i;
+        unsigned long long u;
+        double d;
+        const void* p;
+    };
+};
+
+template <typename T> inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, log_arg_t>::type make_log_arg(T x)
+{
+    log_arg_t a;
+    a.type = log_arg_t::TYPE_INT;
+    a.i = x;
+    return a;
+}
+
+template <typename T> inline typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value, log_arg_t>::type make_log_arg(T x)
+{
+    log_arg_t a;
+    a.type = log_arg_t::TYPE_UINT;
+    a.u = x;
+    return a;
+}
+
+template <typename T> inline typename std::enable_if<std::is_enum<T>::value, log_arg_t>::type make_log_arg(T x)
+{
+    log_arg_t a;
+    a.type = log_arg_t::TYPE_INT;
+    a.i = (long long)x;
+    return a;
+}
+
+template <typename T> inline typename std::enable_if<std::is_floating_point<T>::value, log_arg_t>::type make_log_arg(T x)
+{
+    log_arg_t a;
+    a.type = log_arg_t::TYPE_DOUBLE;
+    a.d = x;
+    return a;
+}
+
+template <typename T> inline log_arg_t make_log_arg(T* x)
+{
+    log_arg_t a;
+    a.type = log_arg_t::TYPE_PTR;
+    a.p = (const void*)x;
+    return a;
+}
+
+inline log_arg_t make_log_arg(std::nullptr_t)
+{
+    log_arg_t a;
+    a.type = log_arg_t::TYPE_PTR;
+    a.p = NULL;
+    return a;
+}
+
+/**
+ * Static descriptor for a single dc_log macro invocation
+ *
+ * Registered with the console the first time the macro is reached, after which enabled is kept up to date
+ * by the convar log_level and the commands log_enable/log_disable
+ */
+struct log_callsite_t
+{
+    const char* fname;
+
+    /** Set by register_callsite(), only read with the registry locked */
+    const char* func;
+
+    int line;
+    log_level_t lvl;
+
+    /**
+     * -1: Not registered yet, 0: Disabled, 1: Enabled
+     */
+    std::atomic<signed char> enabled;
+
+    /** Next registered callsite, set once during registration */
+    log_callsite_t* next;
+
+    /** Rate limiter state, time in nanoseconds at which the token bucket will be full again */
+    std::atomic<unsigned long long> rate_full_time;
+
+    /** Messages dropped by the rate limiter that have not been reported yet */
+    std::atomic<unsigned int> rate_suppressed;
+};
+
+/**
+ * Register a callsite with the console and calculate its state
+ *
+ * Safe to call from any thread
+ *
+ * @param func Function containing the callsite, stored in site->func
+ *
+ * @returns true if the callsite is enabled
+ */
+bool register_callsite(log_callsite_t* site, const char* func);
+
+/**
+ * Print a log message to the console without formatting it on the calling thread
+ *
+ * The arguments are captured in binary form (Strings consumed by %s are copied), and formatting is
+ * done when the message is moved to the console, or immediately if the convar console_log_deferred is 0
+ *
+ * Messages are subject to the per-callsite rate limit set by the convars log_rate_limit and log_rate_burst,
+ * the number of dropped messages is attached to the next message from the callsite that gets through
+ *
+ * You should probably use one of the dc_log macros instead of calling it directly
+ *
+ * Safe to call from any thread
+ *
+ * @param site Callsite of the log call, a level of LEVEL_INTERNAL disables fname, func, and line
+ * @param func Function containing the log call
+ * @param fmt printf style format string, this must remain valid for the lifetime of the program (ie. a string literal)
+ * @param args Arguments consumed by fmt
+ * @param num_args Number of elements in args
+ */
+void add_log_argv(log_callsite_t* site, const char* func, const char* fmt, const log_arg_t* args, int num_args);
+
+inline void add_log_deferred(log_callsite_t* site, const char* func, const char* fmt) { add_log_argv(site, func, fmt, NULL, 0); }
+
+template <typename... Args> inline void add_log_deferred(log_callsite_t* site, const char* func, const char* fmt, Args... args)
+{
+    const log_arg_t argv[] = { make_log_arg(args)... };
+    add_log_argv(site, func, fmt, argv, sizeof...(Args));
+}
+
+/**
+ * Never called, only exists so that the dc_log macros get format string checking
+ */
+inline void log_format_check(const char* fmt, ...) STBSP__ATTRIBUTE_FORMAT(1, 2);
+inline void log_format_check(const char*, ...) { }
+
+/**
+ * Move all pending log messages to the console and write them to stdout before returning
+ *
+ * Log messages are normally written to stdout in batches by a background thread every console_log_flush_ms milliseconds
+ *
+ * Safe to call from any thread, does nothing if the console has not been constructed yet or was already destroyed
+ */
+void flush_log();
+
+/**
+ * Like flush_log(), but never waits, for use on paths that may already be inside a flush (ie. util::die())
+ *
+ * @returns false if the console does not exist or another flush (Possibly on this thread) is in progress
+ */
+bool try_flush_log();
+
 /**
  * Run a registered command
  *
@@ -80,13 +267,64 @@ void add_log(log_level_t lvl, const char* fname, const char* func, int line, con
  * WARNING: This function is not safe to call from multiple threads
  */
 void run_command(const char* fmt, ...) STBSP__ATTRIBUTE_FORMAT(1, 2);
+
+/**
+ * Run a registered command on the main thread, with tetra::post_to_main()
+ *
+ * The command is formatted immediately and run by the next tetra::start_frame()
+ *
+ * Safe to call from any thread
+ */
+void run_command_async(const char* fmt, ...) STBSP__ATTRIBUTE_FORMAT(1, 2);
 };
 
-#define dc_log_internal(fmt, ...) dev_console::add_log(dev_console::LEVEL_INTERNAL, __FILE_NAME__, __func__, __LINE__, fmt, ##__VA_ARGS__)
-#define dc_log(fmt, ...) dev_console::add_log(dev_console::LEVEL_INFO, __FILE_NAME__, __func__, __LINE__, fmt, ##__VA_ARGS__)
-#define dc_log_warn(fmt, ...) dev_console::add_log(dev_console::LEVEL_WARN, __FILE_NAME__, __func__, __LINE__, fmt, ##__VA_ARGS__)
-#define dc_log_trace(fmt, ...) dev_console::add_log(dev_console::LEVEL_TRACE, __FILE_NAME__, __func__, __LINE__, fmt, ##__VA_ARGS__)
-#define dc_log_error(fmt, ...) dev_console::add_log(dev_console::LEVEL_ERROR, __FILE_NAME__, __func__, __LINE__, fmt, ##__VA_ARGS__)
-#define dc_log_fatal(fmt, ...) dev_console::add_log(dev_console::LEVEL_FATAL, __FILE_NAME__, __func__, __LINE__, fmt, ##__VA_ARGS__)
+/**
+ * The dc_log macros only accept string literals as format strings, use dev_console::add_log() for anything else
+ *
+ * The callsite lives in a lambda so that the macros stay expressions, __func__ is passed in as inside the lambda it would be "operator()"
+ */
+#define TETRA_LOG_IMPL(LEVEL, fmt, ...)                                                                                               \
+    ([&](const char* tetra_log_func) {                                                                                                \
+        static dev_console::log_callsite_t tetra_log_callsite = { __FILE_NAME__, NULL, __LINE__, LEVEL, { -1 }, NULL, { 0 }, { 0 } }; \
+        signed char tetra_log_enabled = tetra_log_callsite.enabled.load(std::memory_order_relaxed);                                   \
+        if (tetra_log_enabled > 0 || (tetra_log_enabled < 0 && dev_console::register_callsite(&tetra_log_callsite, tetra_log_func)))  \
+            (false ? dev_console::log_format_check(fmt, ##__VA_ARGS__)                                                                \
+                   : dev_console::add_log_deferred(&tetra_log_callsite, tetra_log_func, "" fmt, ##__VA_ARGS__));                      \
+    }(__func__))
+
+/* Keeps format checking (and any variables only used by the call) without evaluating anything */
+#define TETRA_LOG_COMPILED_OUT(fmt, ...) (false ? dev_console::log_format_check("" fmt, ##__VA_ARGS__) : (void)0)
+
+#define dc_log_internal(fmt, ...) TETRA_LOG_IMPL(dev_console::LEVEL_INTERNAL, fmt, ##__VA_ARGS__)
+
+#if TETRA_LOG_MIN_LEVEL >= 0
+#define dc_log_fatal(fmt, ...) TETRA_LOG_IMPL(dev_console::LEVEL_FATAL, fmt, ##__VA_ARGS__)
+#else
+#define dc_log_fatal(fmt, ...) TETRA_LOG_COMPILED_OUT(fmt, ##__VA_ARGS__)
+#endif
+
+#if TETRA_LOG_MIN_LEVEL >= 1
+#define dc_log_error(fmt, ...) TETRA_LOG_IMPL(dev_console::LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#else
+#define dc_log_error(fmt, ...) TETRA_LOG_COMPILED_OUT(fmt, ##__VA_ARGS__)
+#endif
+
+#if TETRA_LOG_MIN_LEVEL >= 2
+#define dc_log_warn(fmt, ...) TETRA_LOG_IMPL(dev_console::LEVEL_WARN, fmt, ##__VA_ARGS__)
+#else
+#define dc_log_warn(fmt, ...) TETRA_LOG_COMPILED_OUT(fmt, ##__VA_ARGS__)
+#endif
+
+#if TETRA_LOG_MIN_LEVEL >= 3
+#define dc_log(fmt, ...) TETRA_LOG_IMPL(dev_console::LEVEL_INFO, fmt, ##__VA_ARGS__)
+#else
+#define dc_log(fmt, ...) TETRA_LOG_COMPILED_OUT(fmt, ##__VA_ARGS__)
+#endif
+
+#if TETRA_LOG_MIN_LEVEL >= 4
+#define dc_log_trace(fmt, ...) TETRA_LOG_IMPL(dev_console::LEVEL_TRACE, fmt, ##__VA_ARGS__)
+#else
+#define dc_log_trace(fmt, ...) TETRA_LOG_COMPILED_OUT(fmt, ##__VA_ARGS__)
+#endif
 
 #endif
@@ -25,6 +25,8 @@
 #include <SDL3/SDL_revision.h>
 #include <SDL3/SDL_version.h>
 
+#include <atomic>
+
 #include "tetra/gui/console.h"
 #include "tetra/util/cli_parser.h"
 #include "tetra/util/convar.h"
@@ -43,6 +45,102 @@ std::atomic<float> dev_console::add_log_font_width = { 7.0f };
 
 bool tetra::internal::is_initialized_core() { return init_counter > 0; }
 
+static convar_float_t post_budget_ms("tetra_post_budget_ms", 2.0f, 0.0f, 1000.0f,
+    "Time each frame may spend running functions posted to the main thread, at least one is always run (0 for no limit) (ms)", CONVAR_FLAG_DEV_ONLY);
+
+/**
+ * Unbounded MPSC queue for tetra::post_to_main(), based on Dmitry Vyukov's non-intrusive MPSC node based queue
+ *
+ * Pushing is a single atomic exchange, popping is only done by the main thread
+ */
+struct post_queue_t
+{
+    struct node_t
+    {
+        std::atomic<node_t*> next;
+        std::function<void()> fn;
+    };
+
+    /** Most recently pushed node */
+    std::atomic<node_t*> head;
+
+    /** Node whose function was most recently popped (Or the initial empty node), owned by the consumer */
+    node_t* tail;
+
+    post_queue_t()
+    {
+        tail = new node_t();
+        tail->next.store(NULL, std::memory_order_relaxed);
+        head.store(tail, std::memory_order_relaxed);
+    }
+
+    ~post_queue_t()
+    {
+        std::function<void()> fn;
+        while (pop(fn))
+            ;
+        delete tail;
+    }
+
+    void push(std::function<void()>&& fn)
+    {
+        node_t* n = new node_t();
+        n->next.store(NULL, std::memory_order_relaxed);
+        n->fn = std::move(fn);
+        node_t* prev = head.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    /**
+     * A push that is in progress on another thread may not be visible until a later call
+     *
+     * @returns false if the queue is empty
+     */
+    bool pop(std::function<void()>& fn)
+    {
+        node_t* next = tail->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+        fn = std::move(next->fn);
+        next->fn = nullptr;
+        delete tail;
+        tail = next;
+        return true;
+    }
+};
+
+/* Function local so that functions may be posted from static constructors */
+static post_queue_t& get_post_queue()
+{
+    static post_queue_t queue;
+    return queue;
+}
+
+void tetra::post_to_main(std::function<void()> fn)
+{
+    if (fn)
+        get_post_queue().push(std::move(fn));
+}
+
+size_t tetra::run_posted()
+{
+    post_queue_t& queue = get_post_queue();
+    Uint64 budget = Uint64(post_budget_ms.get() * 1000000.0f);
+    Uint64 start = SDL_GetTicksNS();
+
+    size_t num_run = 0;
+    std::function<void()> fn;
+    while (queue.pop(fn))
+    {
+        fn();
+        fn = nullptr;
+        num_run++;
+        if (budget && SDL_GetTicksNS() - start >= budget)
+            break;
+    }
+    return num_run;
+}
+
 void tetra::init(const char* organization, const char* appname, const char* cfg_path_prefix, int argc, const char** argv, const bool set_sdl_app_metadata)
 {
     if (init_counter++)
@@ -51,6 +149,8 @@ void tetra::init(const char* organization, const char* appname, const char* cfg_
         return;
     }
 
+    dev_console::start_log_sink();
+
     dc_log("SDL Revision (Compiled Against): %s", SDL_REVISION);
     dc_log("SDL Revision (Linked Against):   %s", SDL_GetRevision());
     dc_log("SDL Version (Compiled Against): %d.%d.%d", SDL_MAJOR_VERSION, SDL_MINOR_VERSION, SDL_MICRO_VERSION);
@@ -143,6 +243,8 @@ void tetra::init(const char* organization, const char* appname, const char* cfg_
     /* Lock out changes to convars with CONVAR_FLAG_CLI_ONLY */
     convar_t::cli_lockout_init();
 
+    dev_console::open_log_file();
+
     if (cli_parser::get_value("-help") || cli_parser::get_value("help") || cli_parser::get_value("h"))
     {
         dc_log_internal("Usage: %s [ -convar_name [convar_value], ...]", argv[0]);
@@ -207,8 +309,12 @@ void tetra::deinit()
 
     convar_t::atexit_callback();
 
+    dev_console::close_log_file();
+
     PHYSFS_deinit();
     dc_log("[tetra_core]: Deinit finished");
+
+    dev_console::flush_log();
 }
 
 tetra::iteration_limiter_t::iteration_limiter_t(const int max_iterations_per_second) { set_limit(max_iterations_per_second); }
@@ -60,6 +60,7 @@
 #define MCS_B181_TETRA_H
 
 #include <SDL3/SDL_stdinc.h>
+#include <functional>
 
 namespace tetra
 {
@@ -73,6 +74,26 @@ void init(const char* organization, const char* appname, const char* cfg_path, i
  */
 void deinit();
 
+/**
+ * Queue a function to be run on the main thread by the next tetra::start_frame() (Or tetra::run_posted())
+ *
+ * Functions run in the order they were posted, a burst that exceeds tetra_post_budget_ms is spread over multiple frames
+ *
+ * Safe to call from any thread
+ */
+void post_to_main(std::function<void()> fn);
+
+/**
+ * Run functions queued by tetra::post_to_main() until the queue is empty or tetra_post_budget_ms has elapsed
+ *
+ * Called by tetra::start_frame(), only needs to be called by programs that do not use one of the tetra backends
+ *
+ * This function should only be called from the main thread
+ *
+ * @returns Number of functions run
+ */
+size_t run_posted();
+
 /** Iteration limiter, because fps limiter sounded too limiting */
 struct iteration_limiter_t
 {
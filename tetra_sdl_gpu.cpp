@@ -76,7 +76,7 @@ static convar_int_t cvr_y("y", -1, -1, SDL_MAX_SINT32, "Initial window position
 static convar_int_t cvr_centered_display("centered_display", 0, 0, SDL_MAX_SINT32, "Display to use for window centering", CONVAR_FLAG_SAVE);
 
 static convar_int_t r_fps_limiter("r_fps_limiter", 300, 0, SDL_MAX_SINT32 - 1, "Max FPS, 0 to disable", CONVAR_FLAG_SAVE);
-static convar_int_t r_vsync("r_vsync", 1, 0, 1, "Enable/Disable vsync", CONVAR_FLAG_INT_IS_BOOL | CONVAR_FLAG_SAVE);
+static convar_int_t r_vsync("r_vsync", 1, 0, 1, "Enable/Disable vsync", CONVAR_FLAG_INT_IS_BOOL | CONVAR_FLAG_SAVE | CONVAR_FLAG_DEFERRED_CALLBACK);
 static convar_int_t gui_demo_window("gui_demo_window", 0, 0, 1, "Show Dear ImGui demo window", CONVAR_FLAG_INT_IS_BOOL | CONVAR_FLAG_DEV_ONLY);
 
 /**
@@ -369,6 +369,9 @@ int tetra::start_frame(bool event_loop)
     while (event_loop && !done && SDL_PollEvent(&event))
         done = process_event(event);
 
+    tetra::run_posted();
+    convar_t::flush_deferred_callbacks();
+
     ImGui::SetCurrentContext(im_ctx_main);
 
     bool show_main = (im_ctx_shown_main || dev_console::shown);
@@ -40,7 +40,7 @@
 
 namespace tetra
 {
-convar_int_t r_vsync("r_vsync", 1, 0, 1, "Enable/Disable vsync", CONVAR_FLAG_INT_IS_BOOL | CONVAR_FLAG_SAVE);
+convar_int_t r_vsync("r_vsync", 1, 0, 1, "Enable/Disable vsync", CONVAR_FLAG_INT_IS_BOOL | CONVAR_FLAG_SAVE | CONVAR_FLAG_DEFERRED_CALLBACK);
 
 ImGuiContext* im_ctx_main = NULL;
 ImGuiContext* im_ctx_overlay = NULL;
@@ -264,6 +264,9 @@ int tetra::start_frame(bool event_loop)
     while (event_loop && !done && SDL_PollEvent(&event))
         done = process_event(event);
 
+    tetra::run_posted();
+    convar_t::flush_deferred_callbacks();
+
     scoped_imgui_context_t _set_ctx(im_ctx_main);
     ImGuiIO& io_main = ImGui::GetIO();
     ImGui::SetCurrentContext(im_ctx_overlay);
@@ -0,0 +1,191 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2026 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "command_tokenizer.h"
+
+#include "tetra/log.h"
+
+#include <SDL3/SDL_stdinc.h>
+#include <string.h>
+
+command_tokenizer_t::~command_tokenizer_t()
+{
+    SDL_free(buf_heap);
+    SDL_free(argv_heap);
+}
+
+bool command_tokenizer_t::push_arg(const char* arg)
+{
+    /* Keep room for the terminating NULL */
+    if (size_t(argc) + 2 > argv_cap)
+    {
+        size_t new_cap = argv_cap * 2;
+        const char** new_argv = (const char**)SDL_realloc(argv_heap, new_cap * sizeof(*new_argv));
+        if (!new_argv)
+            return false;
+        if (!argv_heap)
+            memcpy(new_argv, argv_local, argc * sizeof(*new_argv));
+        argv_heap = new_argv;
+        argv_cap = new_cap;
+        argv = argv_heap;
+    }
+    argv[argc++] = arg;
+    return true;
+}
+
+command_tokenizer_t::result_t command_tokenizer_t::tokenize(const char* line, size_t len, size_t& consumed)
+{
+    argc = 0;
+    raw = NULL;
+    raw_len = 0;
+
+    /* Arguments are never longer than the text they came from, and every argument but the last is followed by a separator */
+    char* out = buf_local;
+    if (len + 1 > sizeof(buf_local))
+    {
+        if (len + 1 > buf_heap_size)
+        {
+            SDL_free(buf_heap);
+            buf_heap_size = len + 1;
+            buf_heap = (char*)SDL_malloc(buf_heap_size);
+        }
+        if (!buf_heap)
+        {
+            buf_heap_size = 0;
+            dc_log_error("Unable to allocate %zu bytes to tokenize a command line", len + 1);
+            argv[0] = NULL;
+            consumed = len;
+            return RESULT_EMPTY;
+        }
+        out = buf_heap;
+    }
+
+    bool in_quote = false;
+    bool in_arg = false;
+    bool out_of_memory = false;
+    size_t raw_end = 0;
+    size_t i = 0;
+    for (; i < len && line[i] != '\0'; i++)
+    {
+        char c = line[i];
+
+        if (!in_quote && c == ';')
+        {
+            i++;
+            break;
+        }
+
+        if (!in_quote && (c == ' ' || c == '\t'))
+        {
+            if (in_arg)
+                *out++ = '\0';
+            in_arg = false;
+            continue;
+        }
+
+        if (!in_arg)
+        {
+            /* Keep scanning so that consumed still ends at the end of the command */
+            if (!out_of_memory && !push_arg(out))
+                out_of_memory = true;
+            in_arg = true;
+            if (!raw)
+                raw = line + i;
+        }
+
+        if (c == '\\')
+        {
+            size_t num = 1;
+            while (i + num < len && line[i + num] == '\\')
+                num++;
+
+            /* Only backslashes before a double quote are special, so that paths like \\server\share are kept as written */
+            bool before_quote = i + num < len && line[i + num] == '"';
+            for (size_t j = before_quote ? num / 2 : num; j > 0; j--)
+                *out++ = '\\';
+
+            if (before_quote && (num & 1))
+            {
+                *out++ = '"';
+                i += num;
+            }
+            else
+                i += num - 1;
+        }
+        else if (c == '"')
+            in_quote = !in_quote;
+        else
+            *out++ = c;
+
+        raw_end = i + 1;
+    }
+    consumed = i;
+
+    if (in_arg)
+        *out++ = '\0';
+
+    if (out_of_memory)
+    {
+        dc_log_error("Unable to allocate space for the arguments of a command with more than %d arguments", argc);
+        argc = 0;
+    }
+    argv[argc] = NULL;
+
+    if (raw)
+        raw_len = raw_end - (raw - line);
+
+    if (out_of_memory)
+        return RESULT_EMPTY;
+
+    if (in_quote)
+        return RESULT_UNTERMINATED_QUOTE;
+
+    return argc ? RESULT_OK : RESULT_EMPTY;
+}
+
+void command_tokenizer_t::append_quoted(std::string& out, const char* arg, size_t len)
+{
+    out.push_back('"');
+    for (size_t i = 0; i < len; i++)
+    {
+        if (arg[i] == '"')
+        {
+            out.append("\\\"");
+            continue;
+        }
+
+        if (arg[i] != '\\')
+        {
+            out.push_back(arg[i]);
+            continue;
+        }
+
+        /* Backslashes are only doubled when a double quote follows, including the closing one */
+        size_t num = 1;
+        while (i + num < len && arg[i + num] == '\\')
+            num++;
+        bool before_quote = i + num == len || arg[i + num] == '"';
+        out.append(before_quote ? num * 2 : num, '\\');
+        i += num - 1;
+    }
+    out.push_back('"');
+}
@@ -0,0 +1,103 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2026 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef TETRA__UTIL__COMMAND_TOKENIZER_H
+#define TETRA__UTIL__COMMAND_TOKENIZER_H
+
+#include <stddef.h>
+#include <string>
+
+/**
+ * Splits console command lines into argc/argv
+ *
+ * - Arguments are separated by spaces or tabs
+ * - Double quotes group text into a single argument, and may appear in the middle of an argument (a"b c"d is "ab cd")
+ * - Backslashes are kept as is unless they come right before a double quote, then every pair of them becomes one backslash,
+ *   and if one is left over the double quote is kept as a regular character (\" is ", \\" is \ then a quote, \\server is \\server)
+ * - An unquoted ; ends the command, the rest of the line is left for the next call to tokenize()
+ *
+ * argv is written to a buffer inside the tokenizer, the heap is only used for lines longer than COMMAND_TOKENIZER_LOCAL_BUF
+ * or commands with more than COMMAND_TOKENIZER_LOCAL_ARGS arguments, and is then reused for later calls
+ */
+struct command_tokenizer_t
+{
+    enum result_t
+    {
+        /** argc and argv hold a command */
+        RESULT_OK,
+        /** The command was empty or only whitespace */
+        RESULT_EMPTY,
+        /** The line ended inside of a quote, argc and argv hold what was read */
+        RESULT_UNTERMINATED_QUOTE,
+    };
+
+    command_tokenizer_t() = default;
+    command_tokenizer_t(const command_tokenizer_t&) = delete;
+    command_tokenizer_t& operator=(const command_tokenizer_t&) = delete;
+    ~command_tokenizer_t();
+
+    /**
+     * Tokenize the first command of line
+     *
+     * @param line Command line, does not need to be null terminated
+     * @param len Length of line, tokenizing stops early at a null terminator
+     * @param consumed Set to the number of bytes of line that were used, including the ; that ended the command
+     */
+    result_t tokenize(const char* line, size_t len, size_t& consumed);
+
+    /**
+     * Append arg to out as a double quoted argument that tokenize() turns back into arg
+     *
+     * @param len Length of arg
+     */
+    static void append_quoted(std::string& out, const char* arg, size_t len);
+
+    /** Number of arguments, including the command name */
+    int argc = 0;
+
+    /** Arguments, argv[argc] is NULL, valid until the next call to tokenize() */
+    const char** argv = argv_local;
+
+    /** The command as written, without surrounding whitespace or the ; (For error messages) */
+    const char* raw = NULL;
+    size_t raw_len = 0;
+
+private:
+    /**
+     * @returns False if argv could not be grown
+     */
+    bool push_arg(const char* arg);
+
+    static const size_t COMMAND_TOKENIZER_LOCAL_BUF = 1024;
+    static const size_t COMMAND_TOKENIZER_LOCAL_ARGS = 64;
+
+    char buf_local[COMMAND_TOKENIZER_LOCAL_BUF];
+    const char* argv_local[COMMAND_TOKENIZER_LOCAL_ARGS];
+
+    char* buf_heap = NULL;
+    size_t buf_heap_size = 0;
+
+    const char** argv_heap = NULL;
+    size_t argv_cap = COMMAND_TOKENIZER_LOCAL_ARGS;
+};
+
+#endif
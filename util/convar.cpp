@@ -22,13 +22,16 @@
  */
 #include "convar.h"
 #include "cli_parser.h"
+#include "command_tokenizer.h"
 #include "misc.h"
 #include "tetra/gui/console.h"
 #include "tetra/gui/imgui.h"
 
 #include <SDL3/SDL_assert.h>
+#include <algorithm>
 #include <stdlib.h>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -51,21 +54,83 @@ std::vector<convar_t*>* convar_t::get_convar_list()
     return &_vector;
 }
 
-convar_t* convar_t::get_convar(const char* name)
+/**
+ * Open addressing (Linear probing) hash index of convar names
+ *
+ * Slots keep the hash of the name, so that probing only compares names on a full hash match and growing never rehashes names
+ */
+struct convar_index_t
 {
-    std::vector<convar_t*>* vector = convar_t::get_convar_list();
+    struct slot_t
+    {
+        Uint32 hash;
+        convar_t* cvr;
+    };
 
-    for (size_t i = 0; i < vector->size(); i++)
+    /** Power of two size, kept at most half full */
+    std::vector<slot_t> slots;
+    size_t used = 0;
+
+    void insert(convar_t* cvr)
     {
-        if (strcmp(name, vector->at(i)->get_name()) == 0)
+        if ((used + 1) * 2 > slots.size())
         {
-            return vector->at(i);
+            std::vector<slot_t> old_slots(SDL_max(slots.size() * 2, size_t(256)), slot_t { 0, NULL });
+            old_slots.swap(slots);
+            for (const slot_t& s : old_slots)
+                if (s.cvr)
+                    place(s);
         }
+        place({ cvr->get_name_hash(), cvr });
+        used++;
+    }
+
+    convar_t* find(const char* name, Uint32 hash) const
+    {
+        if (slots.empty())
+            return NULL;
+
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            const slot_t& s = slots[i];
+            if (!s.cvr)
+                return NULL;
+            if (s.hash == hash && strcmp(s.cvr->get_name(), name) == 0)
+                return s.cvr;
+        }
+    }
+
+private:
+    void place(const slot_t& slot)
+    {
+        size_t mask = slots.size() - 1;
+        size_t i = slot.hash & mask;
+        while (slots[i].cvr)
+            i = (i + 1) & mask;
+        slots[i] = slot;
     }
+};
 
-    return NULL;
+/* Function local for the same reason as convar_t::get_convar_list(), convars register during static initialization */
+static convar_index_t& get_convar_index()
+{
+    static convar_index_t index;
+    return index;
 }
 
+Uint32 convar_t::hash_name(const char* name)
+{
+    Uint32 h = 0x811c9dc5u;
+    for (; *name; name++)
+        h = (h ^ Uint8(*name)) * 0x01000193u;
+    return h;
+}
+
+convar_t* convar_t::get_convar(const char* name) { return get_convar_index().find(name, hash_name(name)); }
+
+convar_t* convar_t::get_convar(const char* name, Uint32 name_hash) { return get_convar_index().find(name, name_hash); }
+
 bool convar_t::_atexit = true;
 
 bool convar_t::_cli_lockout = false;
@@ -97,6 +162,122 @@ static bool check_if_convar_exists(const char* _name)
     return exists;
 }
 
+void convar_t::register_convar(convar_t* cvr)
+{
+    cvr->_name_hash = hash_name(cvr->_name);
+    check_if_convar_exists(cvr->_name);
+    convar_t::get_convar_list()->push_back(cvr);
+    get_convar_index().insert(cvr);
+}
+
+/** Convars with a deferred post-callback pending, only touched from the main thread */
+static std::vector<convar_t*>& get_deferred_callbacks()
+{
+    static std::vector<convar_t*> pending;
+    return pending;
+}
+
+/** Source of generations, ahead of registry_generation until the convar being set has been stamped */
+static std::atomic<Uint64> next_generation { 0 };
+
+/** Highest generation whose convar has been stamped */
+static std::atomic<Uint64> registry_generation { 0 };
+
+Uint64 convar_t::get_registry_generation() { return registry_generation.load(std::memory_order_acquire); }
+
+void convar_t::changed()
+{
+    /*
+     * Stamp the convar before publishing the generation, so that any thread that sees a registry generation also sees the
+     * stamp of the convar that got it, otherwise convar_group_t::poll() could skip past a change that had not landed yet
+     */
+    Uint64 generation = next_generation.fetch_add(1, std::memory_order_relaxed) + 1;
+    _generation.store(generation, std::memory_order_release);
+
+    Uint64 published = registry_generation.load(std::memory_order_relaxed);
+    while (published < generation && !registry_generation.compare_exchange_weak(published, generation, std::memory_order_release, std::memory_order_relaxed))
+        ;
+
+    if (!_callback && _listeners.empty())
+        return;
+
+    if (!(_flags & CONVAR_FLAG_DEFERRED_CALLBACK))
+    {
+        run_callbacks();
+        return;
+    }
+
+    if (_callback_pending)
+        return;
+
+    _callback_pending = true;
+    get_deferred_callbacks().push_back(this);
+}
+
+void convar_t::run_callbacks()
+{
+    if (_callback)
+        _callback();
+
+    /* Listeners may remove listeners, so index instead of iterating and skip removed entries */
+    const size_t count = _listeners.size();
+    for (size_t i = 0; i < count && i < _listeners.size(); i++)
+    {
+        if (!_listeners[i].handle)
+            continue;
+        std::function<void()> func = _listeners[i].func;
+        func();
+    }
+}
+
+int convar_t::add_listener(std::function<void()> func)
+{
+    /* Drop entries left behind by remove_listener() */
+    _listeners.erase(std::remove_if(_listeners.begin(), _listeners.end(), [](const listener_t& l) { return l.handle == 0; }), _listeners.end());
+
+    int handle = _listener_next_handle++;
+    _listeners.push_back({ handle, func });
+    return handle;
+}
+
+void convar_t::remove_listener(int handle)
+{
+    for (listener_t& l : _listeners)
+    {
+        if (l.handle != handle || handle == 0)
+            continue;
+
+        /* Entries are only erased by add_listener() so that removing from inside a listener doesn't shift the list being run */
+        l.handle = 0;
+        l.func = nullptr;
+        return;
+    }
+}
+
+void convar_t::flush_deferred_callback()
+{
+    if (!_callback_pending)
+        return;
+
+    _callback_pending = false;
+    run_callbacks();
+}
+
+void convar_t::flush_deferred_callbacks()
+{
+    /* Callbacks may set convars again, those are run in the next flush so that a callback setting its own convar can't loop forever */
+    std::vector<convar_t*> pending;
+    pending.swap(get_deferred_callbacks());
+
+    for (convar_t* cvr : pending)
+        cvr->flush_deferred_callback();
+
+    /* Hand the storage back so that steady state flushes don't allocate */
+    pending.clear();
+    if (get_deferred_callbacks().empty())
+        pending.swap(get_deferred_callbacks());
+}
+
 convar_int_t::convar_int_t(const char* name, int default_value, int min, int max, const char* help_string, CONVAR_FLAGS flags, std::function<void()> func)
 {
     if (min < max)
@@ -114,8 +295,7 @@ convar_int_t::convar_int_t(const char* name, int default_value, int min, int max
     if (_flags & CONVAR_FLAG_CLI_ONLY)
         _flags &= ~CONVAR_FLAG_SAVE;
     _type = CONVAR_TYPE::CONVAR_TYPE_INT;
-    check_if_convar_exists(_name);
-    convar_t::get_convar_list()->push_back(this);
+    register_convar(this);
     cli_parser::apply_to(this);
 }
 
@@ -137,24 +317,27 @@ convar_float_t::convar_float_t(
     if (_flags & CONVAR_FLAG_CLI_ONLY)
         _flags &= ~CONVAR_FLAG_SAVE;
     _type = CONVAR_TYPE::CONVAR_TYPE_FLOAT;
-    check_if_convar_exists(_name);
-    convar_t::get_convar_list()->push_back(this);
+    register_convar(this);
     cli_parser::apply_to(this);
 }
 
 convar_string_t::convar_string_t(const char* name, std::string default_value, const char* help_string, CONVAR_FLAGS flags, std::function<void()> func)
 {
-    _default = default_value;
+    _readers[0].store(0, std::memory_order_relaxed);
+    _readers[1].store(0, std::memory_order_relaxed);
+    _readers_epoch.store(0, std::memory_order_relaxed);
+    _default.store(NULL, std::memory_order_relaxed);
+    _value.store(NULL, std::memory_order_relaxed);
+    publish(_default, default_value);
+    publish(_value, default_value);
     _callback = func;
-    _value = _default;
     _name = name;
     _help_string = help_string;
     _flags = flags;
     if (_flags & CONVAR_FLAG_CLI_ONLY)
         _flags &= ~CONVAR_FLAG_SAVE;
     _type = CONVAR_TYPE::CONVAR_TYPE_STRING;
-    check_if_convar_exists(_name);
-    convar_t::get_convar_list()->push_back(this);
+    register_convar(this);
     cli_parser::apply_to(this);
 }
 
@@ -165,11 +348,10 @@ convar_string_t::convar_string_t(const char* name, std::string default_value, co
             return false;                                    \
         if (_bounded && (i < _min || i > _max))              \
             return false;                                    \
-        if (_pre_callback && !_pre_callback(_value, i))      \
+        if (_pre_callback && !_pre_callback(get(), i))       \
             return false;                                    \
-        _value = i;                                          \
-        if (_callback)                                       \
-            _callback();                                     \
+        _value.store(i, std::memory_order_relaxed);          \
+        changed();                                           \
         return true;                                         \
     }                                                        \
     bool convar_##type##_t::set_default(type i)              \
@@ -185,19 +367,65 @@ convar_string_t::convar_string_t(const char* name, std::string default_value, co
 CONVAR_SET_IMPL(int);
 CONVAR_SET_IMPL(float);
 
+convar_string_t::~convar_string_t()
+{
+    release(_value.exchange(NULL));
+    release(_default.exchange(NULL));
+}
+
+void convar_string_t::publish(std::atomic<snapshot_t*>& slot, std::string value)
+{
+    snapshot_t* snapshot = new snapshot_t();
+    snapshot->refs.store(1, std::memory_order_relaxed);
+    snapshot->value = std::move(value);
+
+    std::lock_guard<std::mutex> lock(_publish_mutex);
+
+    snapshot_t* old = slot.exchange(snapshot, std::memory_order_seq_cst);
+
+    /* Readers that enter after the flip count themselves in the other counter, and can only load the new snapshot */
+    std::atomic<int>& readers = _readers[_readers_epoch.fetch_add(1, std::memory_order_seq_cst) & 1];
+
+    /*
+     * A reader only stays in a counter if it saw the epoch unchanged after entering it, so every reader that may have loaded old
+     * is either counted here or was counted by the previous publish(), which waited for it before releasing _publish_mutex
+     *
+     * Readers that are counted here leave the window after a few instructions, so this does not wait on threads that keep reading
+     */
+    while (readers.load(std::memory_order_seq_cst) != 0)
+        std::this_thread::yield();
+
+    release(old);
+}
+
+std::string convar_string_t::get() const
+{
+    snapshot_t* snapshot = acquire(_value);
+    std::string out = snapshot->value;
+    release(snapshot);
+    return out;
+}
+
+std::string convar_string_t::get_default() const
+{
+    snapshot_t* snapshot = acquire(_default);
+    std::string out = snapshot->value;
+    release(snapshot);
+    return out;
+}
+
 bool convar_string_t::set(std::string i)
 {
-    if (_pre_callback && !_pre_callback(_value, i))
+    if (_pre_callback && !_pre_callback(get_ref(), i))
         return false;
-    _value = i;
-    if (_callback)
-        _callback();
+    publish(_value, std::move(i));
+    changed();
     return true;
 }
 
 bool convar_string_t::set_default(std::string i)
 {
-    _default = i;
+    publish(_default, std::move(i));
     return true;
 }
 
@@ -212,20 +440,44 @@ bool convar_string_t::set_default(std::string i)
     {                                                                                                    \
         _pre_callback = func;                                                                            \
         if (call)                                                                                        \
-            _pre_callback(_value, _value);                                                               \
+            _pre_callback(get(), get());                                                                 \
     };
 
 CONVAR_SET_CALLBACK_IMPL(int, int);
 CONVAR_SET_CALLBACK_IMPL(float, float);
 CONVAR_SET_CALLBACK_IMPL(string, std::string);
 
+bool convar_group_t::changed_since(Uint64 generation) const
+{
+    if (convar_t::get_registry_generation() <= generation)
+        return false;
+
+    for (const convar_t* cvr : _convars)
+        if (cvr->get_generation() > generation)
+            return true;
+
+    return false;
+}
+
+bool convar_group_t::poll(Uint64& last_seen) const
+{
+    /*
+     * Every convar stamped with a generation up to now is visible to changed_since(), a convar set after the load of now may
+     * be reported by this call and again by the next one, which is harmless
+     */
+    Uint64 now = convar_t::get_registry_generation();
+    bool changed = changed_since(last_seen);
+    last_seen = now;
+    return changed;
+}
+
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 #define CLAMP(a, min, max) MAX(min, MIN(a, max))
 
 bool convar_int_t::imgui_edit()
 {
-    int v = _value;
+    int v = get();
     bool ret = false;
     if (ImGui::InputInt(_name, &v))
     {
@@ -241,7 +493,7 @@ bool convar_int_t::imgui_edit()
 
 bool convar_float_t::imgui_edit()
 {
-    float v = _value;
+    float v = get();
     bool ret = false;
     if (ImGui::InputFloat(_name, &v, 0.05f, 0.25f))
     {
@@ -257,7 +509,7 @@ bool convar_float_t::imgui_edit()
 
 bool convar_string_t::imgui_edit()
 {
-    std::string v = _value;
+    std::string v = get_ref();
     bool ret = false;
     if (ImGui::InputText(_name, &v))
     {
@@ -271,9 +523,9 @@ bool convar_string_t::imgui_edit()
 void convar_int_t::log_help()
 {
     if (_bounded)
-        dc_log_internal("\"%s\": %d (default: %d) (Min: %d, Max: %d)", _name, _value, _default, _min, _max);
+        dc_log_internal("\"%s\": %d (default: %d) (Min: %d, Max: %d)", _name, get(), _default, _min, _max);
     else
-        dc_log_internal("\"%s\": %d (default: %d)", _name, _value, _default);
+        dc_log_internal("\"%s\": %d (default: %d)", _name, get(), _default);
     if (_help_string && *_help_string != '\0')
         dc_log_internal("  %s", _help_string);
 }
@@ -281,16 +533,16 @@ void convar_int_t::log_help()
 void convar_float_t::log_help()
 {
     if (_bounded)
-        dc_log_internal("\"%s\": %.3f (default: %.3f) (Min: %.3f, Max: %.3f)", _name, _value, _default, _min, _max);
+        dc_log_internal("\"%s\": %.3f (default: %.3f) (Min: %.3f, Max: %.3f)", _name, get(), _default, _min, _max);
     else
-        dc_log_internal("\"%s\": %.3f (default: %.3f)", _name, _value, _default);
+        dc_log_internal("\"%s\": %.3f (default: %.3f)", _name, get(), _default);
     if (_help_string && *_help_string != '\0')
         dc_log_internal("  %s", _help_string);
 }
 
 void convar_string_t::log_help()
 {
-    dc_log_internal("\"%s\": \"%s\" (default: \"%s\")", _name, _value.c_str(), _default.c_str());
+    dc_log_internal("\"%s\": \"%s\" (default: \"%s\")", _name, get_ref().c_str(), get_default_ref().c_str());
     if (_help_string && *_help_string != '\0')
         dc_log_internal("  %s", _help_string);
 }
@@ -397,8 +649,8 @@ std::string convar_float_t::get_convar_command()
 std::string convar_string_t::get_convar_command()
 {
     std::string out(get_name());
-    out.append(" \"");
-    out.append(get());
-    out.append("\"");
+    out.push_back(' ');
+    ref_t value = get_ref();
+    command_tokenizer_t::append_quoted(out, value.c_str(), value.size());
     return out;
 }
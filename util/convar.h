@@ -24,7 +24,10 @@
 #define TETRA__UTILS__CONVAR_H
 
 #include <SDL3/SDL.h>
+#include <atomic>
 #include <functional>
+#include <initializer_list>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -69,10 +72,22 @@ enum CONVAR_FLAGS_ : Uint32
      * Disables CONVAR_FLAG_SAVE
      */
     CONVAR_FLAG_CLI_ONLY = (1 << 4),
+
+    /**
+     * Applies to all convars
+     *
+     * If set then set() only marks the convar dirty, and the post-callback is run once from convar_t::flush_deferred_callbacks()
+     * no matter how many times the convar was set in between (eg. while dragging a slider)
+     *
+     * The pre-callback is not deferred, as it decides whether set() succeeds
+     */
+    CONVAR_FLAG_DEFERRED_CALLBACK = (1 << 5),
 };
 
 /**
  * NOTE: Once a convar has been created, it must not be destroyed before program exit, doing so will lead to an abort(3) call
+ *
+ * Getting the value of a convar is safe from any thread, setting it should only be done from the main thread (See: tetra::post_to_main())
  */
 class convar_t
 {
@@ -94,6 +109,41 @@ public:
 
     inline const char* get_name() const { return _name; }
 
+    /** Hash of the name, computed by hash_name() when the convar was registered */
+    inline Uint32 get_name_hash() const { return _name_hash; }
+
+    /**
+     * Generation of the last successful set() of this convar, 0 if it was never set
+     *
+     * Generations come from a single counter shared by all convars, so a value greater than an earlier
+     * get_registry_generation() means the convar changed since then (See: convar_group_t)
+     */
+    inline Uint64 get_generation() const { return _generation.load(std::memory_order_acquire); }
+
+    /**
+     * Generation of the last successful set() of any convar
+     */
+    static Uint64 get_registry_generation();
+
+    /**
+     * Adds a listener that is called after the convar is set, alongside the post-callback
+     *
+     * Unlike the post-callback any number of listeners can be added, and they are deferred in the same way
+     * (See: CONVAR_FLAG_DEFERRED_CALLBACK)
+     *
+     * NOTE: Main thread only, and not from inside one of this convar's listeners
+     *
+     * @returns Handle for remove_listener(), never 0
+     */
+    int add_listener(std::function<void()> func);
+
+    /**
+     * Removes a listener added with add_listener(), it is safe to call this from inside a listener
+     *
+     * NOTE: Main thread only
+     */
+    void remove_listener(int handle);
+
     /**
      * Returns true if the dev convar is set
      */
@@ -114,6 +164,18 @@ public:
      */
     static convar_t* get_convar(const char* name);
 
+    /**
+     * Get convar_t from corresponding name, for call sites that look up the same name repeatedly and can hash it once
+     *
+     * @param name_hash Result of hash_name(name)
+     */
+    static convar_t* get_convar(const char* name, Uint32 name_hash);
+
+    /**
+     * Hash a convar name for get_convar() (FNV-1a), the console uses this for command names as well
+     */
+    static Uint32 hash_name(const char* name);
+
     static std::vector<convar_t*>* get_convar_list();
 
     /**
@@ -141,15 +203,100 @@ public:
      */
     static void cli_lockout_init();
 
+    /**
+     * Runs the post-callback of every convar with CONVAR_FLAG_DEFERRED_CALLBACK that was set since the last flush
+     *
+     * This is called once per frame from tetra::start_frame(), call it directly if a change must take effect immediately
+     *
+     * NOTE: Main thread only
+     */
+    static void flush_deferred_callbacks();
+
+    /**
+     * Runs the post-callback now if this convar has a deferred callback pending
+     *
+     * NOTE: Main thread only
+     */
+    void flush_deferred_callback();
+
 protected:
     static bool _atexit;
     static bool _cli_lockout;
 
+    /**
+     * Bumps the generation, then runs the post-callback and listeners, or queues them for flush_deferred_callbacks() if
+     * CONVAR_FLAG_DEFERRED_CALLBACK is set
+     */
+    void changed();
+
+    /**
+     * Runs the post-callback and listeners
+     */
+    void run_callbacks();
+
+    /**
+     * Adds a fully constructed convar to the convar list and the name index
+     */
+    static void register_convar(convar_t* cvr);
+
     CONVAR_TYPE _type;
     CONVAR_FLAGS _flags;
 
     const char* _help_string;
     const char* _name;
+    Uint32 _name_hash;
+
+    std::function<void()> _callback = nullptr;
+    bool _callback_pending = false;
+
+    std::atomic<Uint64> _generation { 0 };
+
+    struct listener_t
+    {
+        int handle;
+        std::function<void()> func;
+    };
+    std::vector<listener_t> _listeners;
+    int _listener_next_handle = 1;
+};
+
+/**
+ * A set of convars that derived state depends on, checking for changes is a few integer compares so it can be done every frame
+ *
+ * Checking for changes is safe from any thread, like reading convars
+ *
+ * Example:
+ *     static convar_group_t group = { &r_a, &r_b };
+ *     static Uint64 last_seen = 0;
+ *     if (group.poll(last_seen))
+ *         rebuild_derived_state();
+ */
+class convar_group_t
+{
+public:
+    convar_group_t() { }
+
+    convar_group_t(std::initializer_list<const convar_t*> convars)
+        : _convars(convars)
+    {
+    }
+
+    inline void add(const convar_t* cvr) { _convars.push_back(cvr); }
+
+    /**
+     * Returns true if any convar in the group was set after generation
+     */
+    bool changed_since(Uint64 generation) const;
+
+    /**
+     * Returns true if any convar in the group was set since last_seen, and sets last_seen to the current registry generation
+     *
+     * @param last_seen Generation from the previous call, start it at 0 to have the first call return true for any convar ever set
+     */
+    bool poll(Uint64& last_seen) const;
+
+private:
+    std::vector<const convar_t*> _convars;
 };
 
 class convar_int_t : public convar_t
@@ -158,7 +305,7 @@ public:
     convar_int_t(
         const char* name, int default_value, int min, int max, const char* help_string, CONVAR_FLAGS flags = 0, std::function<void()> post_callback = NULL);
 
-    inline int get() const { return _value; }
+    inline int get() const { return _value.load(std::memory_order_relaxed); }
 
     inline int get_min() const { return _min; }
 
@@ -171,7 +318,7 @@ public:
      * 1. Performs bounds checking
      * 2. Calls pre_callback (if set)
      * 3. Sets the value
-     * 4. Calls post_callback (if set)
+     * 4. Calls post_callback (if set), or defers it (See: CONVAR_FLAG_DEFERRED_CALLBACK)
      *
      * Returns true if all went well, returns false if any step failed
      */
@@ -211,13 +358,12 @@ public:
     std::string get_convar_command();
 
 protected:
-    int _value;
+    std::atomic<int> _value;
     int _default;
     int _bounded;
     int _min;
     int _max;
     std::function<bool(int _prev, int _new)> _pre_callback = nullptr;
-    std::function<void()> _callback = nullptr;
 };
 
 class convar_float_t : public convar_t
@@ -226,7 +372,7 @@ public:
     convar_float_t(const char* name, float default_value, float min, float max, const char* help_string, CONVAR_FLAGS flags = 0,
         std::function<void()> post_callback = NULL);
 
-    inline float get() const { return _value; }
+    inline float get() const { return _value.load(std::memory_order_relaxed); }
 
     inline float get_min() const { return _min; }
 
@@ -239,7 +385,7 @@ public:
      * 1. Performs bounds checking
      * 2. Calls pre_callback (if set)
      * 3. Sets the value
-     * 4. Calls post_callback (if set)
+     * 4. Calls post_callback (if set), or defers it (See: CONVAR_FLAG_DEFERRED_CALLBACK)
      *
      * Returns true if all went well, returns false if any step failed
      */
@@ -279,34 +425,113 @@ public:
     std::string get_convar_command();
 
 protected:
-    float _value;
+    std::atomic<float> _value;
     float _default;
     int _bounded;
     float _min;
     float _max;
     std::function<bool(float _prev, float _new)> _pre_callback = nullptr;
-    std::function<void()> _callback = nullptr;
 };
 
 class convar_string_t : public convar_t
 {
+protected:
+    struct snapshot_t;
+
 public:
+    /**
+     * Reference to a value of a convar_string_t, the value stays valid and unchanged for as long as the reference is held
+     *
+     * Getting, copying, or destroying a reference never locks or allocates, so this is how to read string convars every
+     * frame or from other threads
+     */
+    class ref_t
+    {
+    public:
+        ref_t(const ref_t& other)
+            : _snapshot(other._snapshot)
+        {
+            _snapshot->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        ref_t(ref_t&& other)
+            : _snapshot(other._snapshot)
+        {
+            other._snapshot = NULL;
+        }
+
+        ref_t& operator=(ref_t other)
+        {
+            std::swap(_snapshot, other._snapshot);
+            return *this;
+        }
+
+        ~ref_t() { release(_snapshot); }
+
+        inline const std::string& str() const { return _snapshot->value; }
+
+        inline const char* c_str() const { return _snapshot->value.c_str(); }
+
+        inline size_t size() const { return _snapshot->value.size(); }
+
+        inline operator const std::string&() const { return _snapshot->value; }
+
+        inline bool operator==(const ref_t& other) const { return _snapshot == other._snapshot || str() == other.str(); }
+
+        inline bool operator!=(const ref_t& other) const { return !(*this == other); }
+
+    private:
+        friend class convar_string_t;
+
+        explicit ref_t(snapshot_t* snapshot)
+            : _snapshot(snapshot)
+        {
+        }
+
+        snapshot_t* _snapshot;
+    };
+
     convar_string_t(const char* name, std::string default_value, const char* help_string, CONVAR_FLAGS flags = 0, std::function<void()> post_callback = NULL);
 
-    inline std::string get() const { return _value; }
+    ~convar_string_t();
 
-    inline std::string get_default() const { return _default; }
+    /**
+     * Copies the value, use get_ref() to avoid the copy
+     */
+    std::string get() const;
+
+    /**
+     * Copies the default value, use get_default_ref() to avoid the copy
+     */
+    std::string get_default() const;
+
+    inline ref_t get_ref() const { return ref_t(acquire(_value)); }
+
+    inline ref_t get_default_ref() const { return ref_t(acquire(_default)); }
 
     /**
      * Steps:
      * 1. Calls pre_callback (if set)
      * 2. Sets the value
-     * 3. Calls post_callback (if set)
+     * 3. Calls post_callback (if set), or defers it (See: CONVAR_FLAG_DEFERRED_CALLBACK)
      *
      * Returns true if all went well, returns false if any step failed
      */
     bool set(std::string i);
 
+    /**
+     * See: set(std::string i)
+     */
+    inline bool set(const char* i) { return set(std::string(i)); }
+
+    /**
+     * See: set(std::string i)
+     *
+     * @param i Value, does not need to be null terminated
+     * @param len Length of i
+     */
+    inline bool set(const char* i, size_t len) { return set(std::string(i, len)); }
+
     /**
      * Steps:
      * 1. Sets the default value
@@ -340,10 +565,66 @@ public:
     std::string get_convar_command();
 
 protected:
-    std::string _value;
-    std::string _default;
+    /** Immutable value, shared by the convar and any readers, freed when the last reference is released */
+    struct snapshot_t
+    {
+        std::atomic<int> refs;
+        std::string value;
+    };
+
+    /**
+     * Take a reference to the snapshot in slot, this never locks or allocates
+     */
+    inline snapshot_t* acquire(const std::atomic<snapshot_t*>& slot) const
+    {
+        /*
+         * The epoch is checked again after entering, a reader that entered a counter after the epoch moved on could otherwise
+         * load a snapshot that a later publish() frees without waiting on that counter
+         */
+        unsigned int epoch = _readers_epoch.load(std::memory_order_seq_cst);
+        for (;;)
+        {
+            _readers[epoch & 1].fetch_add(1, std::memory_order_seq_cst);
+            unsigned int epoch_now = _readers_epoch.load(std::memory_order_seq_cst);
+            if (epoch_now == epoch)
+                break;
+            _readers[epoch & 1].fetch_sub(1, std::memory_order_release);
+            epoch = epoch_now;
+        }
+        std::atomic<int>& readers = _readers[epoch & 1];
+        snapshot_t* snapshot = slot.load(std::memory_order_seq_cst);
+        snapshot->refs.fetch_add(1, std::memory_order_relaxed);
+        readers.fetch_sub(1, std::memory_order_release);
+        return snapshot;
+    }
+
+    static inline void release(snapshot_t* snapshot)
+    {
+        if (snapshot && snapshot->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete snapshot;
+    }
+
+    /**
+     * Replace the snapshot in slot, the old snapshot is released once no reader can be between loading it and taking a reference
+     */
+    void publish(std::atomic<snapshot_t*>& slot, std::string value);
+
+    std::atomic<snapshot_t*> _value;
+    std::atomic<snapshot_t*> _default;
+
+    /**
+     * Number of readers between loading a snapshot pointer and taking a reference to it, split by the parity of
+     * _readers_epoch at the time they entered, so that publish() only waits for readers that may have loaded the old snapshot
+     */
+    mutable std::atomic<int> _readers[2];
+
+    /** Incremented by every publish(), readers count themselves in _readers[_readers_epoch & 1] */
+    std::atomic<unsigned int> _readers_epoch;
+
+    /** Serializes publish(), so that a publish() only starts once the readers of the previous one have left */
+    std::mutex _publish_mutex;
+
     std::function<bool(std::string _prev, std::string _new)> _pre_callback = nullptr;
-    std::function<void()> _callback = nullptr;
 };
 
 namespace ImGui
@@ -41,10 +41,11 @@ void convar_file_parser::set_config_prefix(const char* prefix)
 
 bool convar_file_parser::write()
 {
-    PHYSFS_File* fd = PHYSFS_openWrite(user_config_path.get().c_str());
+    convar_string_t::ref_t path = user_config_path.get_ref();
+    PHYSFS_File* fd = PHYSFS_openWrite(path.c_str());
     if (!fd)
     {
-        dc_log_warn("Unable to write user config to: \"%s\"", user_config_path.get().c_str());
+        dc_log_warn("Unable to write user config to: \"%s\"", path.c_str());
         return false;
     }
 
@@ -83,7 +84,7 @@ bool convar_file_parser::write()
         case convar_t::CONVAR_TYPE::CONVAR_TYPE_STRING:
         {
             convar_string_t* cvr_string = (convar_string_t*)cvr;
-            if (cvr_string->get() == cvr_string->get_default())
+            if (cvr_string->get_ref() == cvr_string->get_default_ref())
                 continue;
             std::string cmd = cvr->get_convar_command();
             PHYSFS_writeBytes(fd, cmd.c_str(), cmd.length());
@@ -102,7 +103,7 @@ bool convar_file_parser::write()
 
 void convar_file_parser::read()
 {
-    SDL_IOStream* stream = PHYSFSSDL3_openRead(user_config_path.get().c_str());
+    SDL_IOStream* stream = PHYSFSSDL3_openRead(user_config_path.get_ref().c_str());
     if (!stream)
     {
         dc_log_error("Error loading convar file: %s", SDL_GetError());
@@ -0,0 +1,442 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2026 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "log_file.h"
+
+#include "tetra/log.h"
+#include "tetra/util/log_format.h"
+
+#include <SDL3/SDL_endian.h>
+#include <SDL3/SDL_time.h>
+#include <SDL3/SDL_timer.h>
+#include <algorithm>
+
+#define LOG_FILE_MAGIC "TLOG"
+#define LOG_FILE_VERSION 1
+#define LOG_FILE_DIR "logs"
+#define LOG_FILE_PREFIX "console_"
+#define LOG_FILE_SUFFIX ".tlog"
+
+struct record_writer_t
+{
+    char* buf;
+    size_t len;
+    size_t pos;
+    bool ok;
+
+    void put(const void* data, size_t data_len)
+    {
+        if (!ok || pos + data_len > len)
+        {
+            ok = false;
+            return;
+        }
+        memcpy(buf + pos, data, data_len);
+        pos += data_len;
+    }
+
+    void put_u8(Uint8 x) { put(&x, 1); }
+
+    void put_u16(Uint16 x)
+    {
+        x = SDL_Swap16LE(x);
+        put(&x, 2);
+    }
+
+    void put_u32(Uint32 x)
+    {
+        x = SDL_Swap32LE(x);
+        put(&x, 4);
+    }
+
+    void put_u64(Uint64 x)
+    {
+        x = SDL_Swap64LE(x);
+        put(&x, 8);
+    }
+
+    void put_str(const char* str, size_t str_len)
+    {
+        str_len = SDL_min(str_len, size_t(SDL_MAX_UINT16));
+        put_u16(str_len);
+        put(str, str_len);
+    }
+
+    /** Writes at most max_len bytes of str */
+    void put_str_max(const char* str, size_t max_len) { put_str(str ? str : "", str ? SDL_min(strlen(str), max_len) : 0); }
+
+    size_t result() const { return ok ? pos : 0; }
+};
+
+size_t log_file::encode_callsite(
+    char* buf, size_t buf_len, size_t str_max, Uint32 id, const char* fname, const char* func, int line, int lvl, const char* fmt)
+{
+    record_writer_t w = { buf, buf_len, 0, true };
+    w.put_u8(RECORD_CALLSITE);
+    w.put_u32(id);
+    w.put_u32(line);
+    w.put_u8(lvl);
+    w.put_str_max(fname, str_max);
+    w.put_str_max(func, str_max);
+    w.put_str_max(fmt, str_max);
+    return w.result();
+}
+
+size_t log_file::encode_message(
+    char* buf, size_t buf_len, bool is_payload, Uint64 time, Uint32 callsite, Uint32 suppressed, const char* data, size_t data_len)
+{
+    record_writer_t w = { buf, buf_len, 0, true };
+    w.put_u8(is_payload ? RECORD_PAYLOAD : RECORD_TEXT);
+    w.put_u64(time);
+    w.put_u32(callsite);
+    w.put_u32(suppressed);
+    w.put_str(data, data_len);
+    return w.result();
+}
+
+size_t log_file::encode_repeat(char* buf, size_t buf_len, Uint32 count)
+{
+    record_writer_t w = { buf, buf_len, 0, true };
+    w.put_u8(RECORD_REPEAT);
+    w.put_u32(count);
+    return w.result();
+}
+
+struct record_reader_t
+{
+    const Uint8* buf;
+    size_t len;
+    size_t pos;
+    bool ok;
+
+    const Uint8* get(size_t data_len)
+    {
+        if (!ok || pos + data_len > len)
+        {
+            ok = false;
+            return NULL;
+        }
+        pos += data_len;
+        return buf + pos - data_len;
+    }
+
+    Uint8 get_u8()
+    {
+        const Uint8* p = get(1);
+        return p ? *p : 0;
+    }
+
+    Uint16 get_u16()
+    {
+        Uint16 x = 0;
+        const Uint8* p = get(2);
+        if (p)
+            memcpy(&x, p, 2);
+        return SDL_Swap16LE(x);
+    }
+
+    Uint32 get_u32()
+    {
+        Uint32 x = 0;
+        const Uint8* p = get(4);
+        if (p)
+            memcpy(&x, p, 4);
+        return SDL_Swap32LE(x);
+    }
+
+    Uint64 get_u64()
+    {
+        Uint64 x = 0;
+        const Uint8* p = get(8);
+        if (p)
+            memcpy(&x, p, 8);
+        return SDL_Swap64LE(x);
+    }
+
+    std::string get_str()
+    {
+        Uint16 str_len = get_u16();
+        const Uint8* p = get(str_len);
+        return p ? std::string((const char*)p, str_len) : std::string();
+    }
+};
+
+struct callsite_t
+{
+    std::string fname;
+    std::string func;
+    std::string fmt;
+    int line;
+    int lvl;
+};
+
+bool log_file::read(const char* path, std::function<void(const message_t& msg)> callback)
+{
+    PHYSFS_File* fd = PHYSFS_openRead(path);
+    if (!fd)
+        return false;
+
+    std::vector<Uint8> data;
+    Sint64 fd_len = PHYSFS_fileLength(fd);
+    if (fd_len > 0)
+    {
+        data.resize(fd_len);
+        Sint64 bytes_read = PHYSFS_readBytes(fd, data.data(), data.size());
+        data.resize(SDL_max(bytes_read, Sint64(0)));
+    }
+    PHYSFS_close(fd);
+
+    record_reader_t r = { data.data(), data.size(), 0, true };
+
+    const Uint8* magic = r.get(4);
+    if (!magic || memcmp(magic, LOG_FILE_MAGIC, 4) != 0 || r.get_u32() != LOG_FILE_VERSION)
+        return false;
+
+    Sint64 session_time = 0;
+    Uint64 session_ticks = 0;
+    std::vector<callsite_t> callsites;
+
+    bool have_msg = false;
+    message_t msg;
+    std::string msg_text;
+    char buf[2048];
+
+    while (r.ok && r.pos < r.len)
+    {
+        Uint8 type = r.get_u8();
+
+        if (type == RECORD_REPEAT)
+        {
+            Uint32 count = r.get_u32();
+            if (r.ok && have_msg)
+                msg.repeat += count;
+            continue;
+        }
+
+        /* Every other record ends the previous message */
+        if (have_msg)
+        {
+            msg.text = msg_text.c_str();
+            callback(msg);
+            have_msg = false;
+        }
+
+        switch (type)
+        {
+        case RECORD_SESSION:
+            session_time = r.get_u64();
+            session_ticks = r.get_u64();
+            break;
+        case RECORD_CALLSITE:
+        {
+            Uint32 id = r.get_u32();
+            callsite_t c;
+            c.line = (Sint32)r.get_u32();
+            c.lvl = (Sint8)r.get_u8();
+            c.fname = r.get_str();
+            c.func = r.get_str();
+            c.fmt = r.get_str();
+            if (!r.ok || id > 1024 * 1024)
+                break;
+            if (callsites.size() <= id)
+                callsites.resize(id + 1);
+            callsites[id] = c;
+            break;
+        }
+        case RECORD_TEXT:
+        case RECORD_PAYLOAD:
+        {
+            Uint64 ticks = r.get_u64();
+            Uint32 id = r.get_u32();
+            msg.suppressed = r.get_u32();
+            std::string str = r.get_str();
+            if (!r.ok)
+                break;
+
+            static const callsite_t unknown = { "unknown", "unknown", "", -1, dev_console::LEVEL_INFO };
+            const callsite_t& c = id < callsites.size() ? callsites[id] : unknown;
+
+            if (type == RECORD_PAYLOAD)
+            {
+                log_format::format(buf, sizeof(buf), c.fmt.c_str(), str.data(), str.size());
+                msg_text = buf;
+            }
+            else
+                msg_text = str;
+
+            msg.time = session_time ? session_time + Sint64(ticks - session_ticks) * SDL_NS_PER_MS : 0;
+            msg.lvl = c.lvl;
+            msg.fname = c.fname.c_str();
+            msg.func = c.func.c_str();
+            msg.line = c.line;
+            msg.repeat = 1;
+            have_msg = true;
+            break;
+        }
+        default:
+            r.ok = false;
+            break;
+        }
+    }
+
+    if (have_msg)
+    {
+        msg.text = msg_text.c_str();
+        callback(msg);
+    }
+
+    return true;
+}
+
+/**
+ * Get the sequence number of a log file name, or -1 if the name is not a log file name
+ */
+static Sint64 get_sequence(const char* name)
+{
+    size_t prefix_len = strlen(LOG_FILE_PREFIX);
+    size_t suffix_len = strlen(LOG_FILE_SUFFIX);
+    size_t len = strlen(name);
+    if (len <= prefix_len + suffix_len || strncmp(name, LOG_FILE_PREFIX, prefix_len) || strcmp(name + len - suffix_len, LOG_FILE_SUFFIX))
+        return -1;
+
+    Sint64 seq = 0;
+    for (size_t i = prefix_len; i < len - suffix_len; i++)
+    {
+        if (name[i] < '0' || name[i] > '9')
+            return -1;
+        seq = seq * 10 + (name[i] - '0');
+    }
+    return seq;
+}
+
+/**
+ * Get the sequence numbers of all log files in the write dir, sorted in ascending order
+ */
+static std::vector<Sint64> list_sequences()
+{
+    std::vector<Sint64> out;
+    char** files = PHYSFS_enumerateFiles(LOG_FILE_DIR);
+    if (!files)
+        return out;
+
+    const char* write_dir = PHYSFS_getWriteDir();
+    for (char** it = files; *it; it++)
+    {
+        Sint64 seq = get_sequence(*it);
+        if (seq < 0)
+            continue;
+
+        /* Ignore log files that are somewhere else in the search path */
+        char path[256];
+        snprintf(path, sizeof(path), LOG_FILE_DIR "/%s", *it);
+        const char* real_dir = PHYSFS_getRealDir(path);
+        if (!write_dir || !real_dir || strcmp(real_dir, write_dir))
+            continue;
+
+        out.push_back(seq);
+    }
+    PHYSFS_freeList(files);
+
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+}
+
+static std::string sequence_path(Sint64 seq)
+{
+    char path[256];
+    snprintf(path, sizeof(path), LOG_FILE_DIR "/" LOG_FILE_PREFIX "%08lld" LOG_FILE_SUFFIX, (long long)seq);
+    return path;
+}
+
+std::vector<std::string> log_file::list_files()
+{
+    std::vector<std::string> out;
+    std::vector<Sint64> seqs = list_sequences();
+    for (Sint64 seq : seqs)
+        out.push_back(sequence_path(seq));
+    return out;
+}
+
+bool log_file::writer_t::prepare(Sint64 max_size, int max_count, const std::vector<char>& callsites)
+{
+    if (fd && fd_size < max_size)
+        return true;
+
+    close();
+
+    if (!PHYSFS_isInit() || !PHYSFS_getWriteDir())
+        return false;
+
+    PHYSFS_mkdir(LOG_FILE_DIR);
+
+    std::vector<Sint64> seqs = list_sequences();
+    Sint64 seq = seqs.size() ? seqs.back() + 1 : 0;
+
+    /* Make room for the new file */
+    for (size_t i = 0; max_count > 0 && i + max_count <= seqs.size(); i++)
+        PHYSFS_delete(sequence_path(seqs[i]).c_str());
+
+    std::string path = sequence_path(seq);
+    fd = PHYSFS_openWrite(path.c_str());
+    if (!fd)
+    {
+        if (!failed)
+            dc_log_error("Unable to open log file \"%s\": %s", path.c_str(), PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        failed = true;
+        return false;
+    }
+    failed = false;
+    fd_size = 0;
+
+    char header[32];
+    record_writer_t w = { header, sizeof(header), 0, true };
+    w.put(LOG_FILE_MAGIC, 4);
+    w.put_u32(LOG_FILE_VERSION);
+    SDL_Time now = 0;
+    SDL_GetCurrentTime(&now);
+    w.put_u8(RECORD_SESSION);
+    w.put_u64(now);
+    w.put_u64(SDL_GetTicks());
+    write(header, w.result());
+    write(callsites.data(), callsites.size());
+
+    return true;
+}
+
+void log_file::writer_t::write(const void* data, size_t len)
+{
+    if (!fd || !len)
+        return;
+    PHYSFS_sint64 written = PHYSFS_writeBytes(fd, data, len);
+    if (written > 0)
+        fd_size += written;
+}
+
+void log_file::writer_t::close()
+{
+    if (!fd)
+        return;
+    PHYSFS_close(fd);
+    fd = NULL;
+    fd_size = 0;
+}
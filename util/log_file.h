@@ -0,0 +1,146 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2026 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef TETRA__UTIL__LOG_FILE_H
+#define TETRA__UTIL__LOG_FILE_H
+
+#include "physfs.h"
+
+#include <SDL3/SDL_stdinc.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Binary console log files
+ *
+ * A file is a header ("TLOG" followed by a little endian Uint32 version) and a stream of records,
+ * each record is a type byte followed by little endian fields
+ * - RECORD_SESSION: Sint64 wall clock time (ns since the unix epoch), Uint64 SDL_GetTicks() at the same moment
+ * - RECORD_CALLSITE: Uint32 id, Sint32 line, Sint8 level, then fname, func, and fmt as strings
+ * - RECORD_TEXT/RECORD_PAYLOAD: Uint64 SDL_GetTicks(), Uint32 callsite id, Uint32 suppressed count, then a string
+ *   holding the formatted message or a payload from log_format::capture() for the fmt of the callsite
+ * - RECORD_REPEAT: Uint32 number of additional times the previous message was repeated
+ *
+ * Strings are a Uint16 length followed by that many bytes
+ */
+struct log_file
+{
+    enum record_type_t : Uint8
+    {
+        RECORD_SESSION = 'S',
+        RECORD_CALLSITE = 'C',
+        RECORD_TEXT = 'T',
+        RECORD_PAYLOAD = 'P',
+        RECORD_REPEAT = 'R',
+    };
+
+    /**
+     * Largest record that encode_callsite() or encode_message() can produce for strings of up to str_len bytes
+     */
+    static constexpr size_t max_record_size(size_t str_len) { return 32 + 3 * (2 + str_len); }
+
+    /**
+     * Strings longer than str_max bytes are truncated, so the record always fits in max_record_size(str_max) bytes
+     *
+     * @returns Length of the record written to buf, or 0 if it did not fit
+     */
+    static size_t encode_callsite(
+        char* buf, size_t buf_len, size_t str_max, Uint32 id, const char* fname, const char* func, int line, int lvl, const char* fmt);
+
+    /** @returns Length of the record written to buf, or 0 if it did not fit */
+    static size_t encode_message(
+        char* buf, size_t buf_len, bool is_payload, Uint64 time, Uint32 callsite, Uint32 suppressed, const char* data, size_t data_len);
+
+    /** @returns Length of the record written to buf, or 0 if it did not fit */
+    static size_t encode_repeat(char* buf, size_t buf_len, Uint32 count);
+
+    /**
+     * A message decoded by read()
+     */
+    struct message_t
+    {
+        /** Wall clock time in nanoseconds since the unix epoch, or 0 if the file had no session record */
+        Sint64 time;
+        int lvl;
+        const char* fname;
+        const char* func;
+        int line;
+        const char* text;
+        Uint32 repeat;
+        Uint32 suppressed;
+    };
+
+    /**
+     * Decode a log file from the PhysFS search path
+     *
+     * @param path PhysFS path of the file
+     * @param callback Called for each message in order
+     *
+     * @returns false if the file could not be opened or is not a log file, messages decoded before a truncated record are still passed to callback
+     */
+    static bool read(const char* path, std::function<void(const message_t& msg)> callback);
+
+    /**
+     * Get the PhysFS paths of all log files in the write dir, oldest first
+     */
+    static std::vector<std::string> list_files();
+
+    /**
+     * Writes records to rotating files in the directory "logs/" of the PhysFS write dir
+     *
+     * Files are named "logs/console_<sequence>.tlog", when the current file exceeds the size limit a new file is
+     * started and the oldest files are deleted until at most the count limit remain
+     *
+     * Not thread safe, callers must serialize access
+     */
+    struct writer_t
+    {
+        PHYSFS_File* fd = NULL;
+        Sint64 fd_size = 0;
+
+        /** Set if opening a file failed, so that the failure is only logged once */
+        bool failed = false;
+
+        /**
+         * Ensure a file is open and that it is under the size limit
+         *
+         * @param max_size Size at which a new file is started
+         * @param max_count Maximum number of files to keep
+         * @param callsites Callsite records written so far, these are written to the start of every new file
+         *
+         * @returns true if a file is open
+         */
+        bool prepare(Sint64 max_size, int max_count, const std::vector<char>& callsites);
+
+        /**
+         * Append data to the current file, prepare() must have returned true
+         */
+        void write(const void* data, size_t len);
+
+        void close();
+
+        ~writer_t() { close(); }
+    };
+};
+
+#endif
@@ -0,0 +1,433 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2026 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "log_format.h"
+
+#include "tetra/util/stb_sprintf.h"
+
+#include <SDL3/SDL_stdinc.h>
+
+/**
+ * A single printf conversion specification
+ */
+struct spec_t
+{
+    /** Pointer to the '%' that started the specification */
+    const char* start;
+
+    /** Pointer to the character following the conversion character */
+    const char* end;
+
+    /** Pointer to the first length modifier character, or the conversion character if there were none */
+    const char* length;
+
+    bool width_star;
+    bool precision_star;
+
+    /** Precision from the format string, or -1 if not present or given by '*' */
+    int precision;
+
+    char conversion;
+};
+
+/**
+ * Parse a conversion specification
+ *
+ * @param p Pointer to the '%' starting the specification
+ */
+static void parse_spec(const char* p, spec_t& spec)
+{
+    spec.start = p++;
+    spec.width_star = false;
+    spec.precision_star = false;
+    spec.precision = -1;
+
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' || *p == '\'' || *p == '_')
+        p++;
+
+    if (*p == '*')
+    {
+        spec.width_star = true;
+        p++;
+    }
+    else
+        while ('0' <= *p && *p <= '9')
+            p++;
+
+    if (*p == '.')
+    {
+        p++;
+        if (*p == '*')
+        {
+            spec.precision_star = true;
+            p++;
+        }
+        else
+        {
+            spec.precision = 0;
+            while ('0' <= *p && *p <= '9')
+                spec.precision = spec.precision * 10 + (*p++ - '0');
+        }
+    }
+
+    spec.length = p;
+    while (*p == 'h' || *p == 'l' || *p == 'L' || *p == 'z' || *p == 'j' || *p == 't' || *p == 'q')
+        p++;
+    if (*p == 'I')
+    {
+        p++;
+        if ((p[0] == '6' && p[1] == '4') || (p[0] == '3' && p[1] == '2'))
+            p += 2;
+    }
+
+    spec.conversion = *p;
+    spec.end = *p ? p + 1 : p;
+}
+
+struct payload_writer_t
+{
+    char* buf;
+    size_t len;
+    size_t pos;
+
+    bool put_value(char tag, const void* data)
+    {
+        if (pos + 9 > len)
+            return false;
+        buf[pos++] = tag;
+        memcpy(buf + pos, data, 8);
+        pos += 8;
+        return true;
+    }
+
+    bool put_arg(const dev_console::log_arg_t& arg)
+    {
+        switch (arg.type)
+        {
+        case dev_console::log_arg_t::TYPE_INT:
+            return put_value('i', &arg.i);
+        case dev_console::log_arg_t::TYPE_UINT:
+            return put_value('u', &arg.u);
+        case dev_console::log_arg_t::TYPE_DOUBLE:
+            return put_value('d', &arg.d);
+        default:
+        {
+            Uint64 p = (uintptr_t)arg.p;
+            return put_value('p', &p);
+        }
+        }
+    }
+
+    bool put_str(const char* str, int precision)
+    {
+        if (!str)
+        {
+            if (pos + 1 > len)
+                return false;
+            buf[pos++] = 'n';
+            return true;
+        }
+
+        /* Tag, length, and null terminator */
+        if (pos + 4 > len)
+            return false;
+
+        size_t max_len = SDL_min(len - pos - 4, size_t(SDL_MAX_UINT16));
+        if (precision >= 0)
+            max_len = SDL_min(max_len, size_t(precision));
+
+        size_t slen = 0;
+        while (slen < max_len && str[slen])
+            slen++;
+
+        Uint16 slen16 = slen;
+        buf[pos++] = 's';
+        memcpy(buf + pos, &slen16, 2);
+        pos += 2;
+        memcpy(buf + pos, str, slen);
+        pos += slen;
+        buf[pos++] = '\0';
+        return true;
+    }
+};
+
+size_t log_format::capture(char* buf, size_t buf_len, const char* fmt, const dev_console::log_arg_t* args, int num_args)
+{
+    payload_writer_t w = { buf, buf_len, 0 };
+
+    int arg = 0;
+    for (const char* p = fmt; *p && arg < num_args;)
+    {
+        if (*p != '%')
+        {
+            p++;
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            p += 2;
+            continue;
+        }
+
+        spec_t spec;
+        parse_spec(p, spec);
+        p = spec.end;
+
+        if (spec.width_star && arg < num_args && !w.put_arg(args[arg++]))
+            break;
+
+        int precision = spec.precision;
+        if (spec.precision_star && arg < num_args)
+        {
+            precision = (int)args[arg].i;
+            if (!w.put_arg(args[arg++]))
+                break;
+        }
+
+        if (arg >= num_args || !spec.conversion)
+            break;
+
+        const dev_console::log_arg_t& a = args[arg++];
+        bool ok;
+        if (spec.conversion == 's' && a.type == dev_console::log_arg_t::TYPE_PTR)
+            ok = w.put_str((const char*)a.p, precision);
+        else if (spec.conversion == 'n')
+            ok = true;
+        else
+            ok = w.put_arg(a);
+        if (!ok)
+            break;
+    }
+
+    if (w.pos < buf_len)
+        buf[w.pos] = '\0';
+
+    return w.pos;
+}
+
+struct payload_reader_t
+{
+    const char* buf;
+    size_t len;
+    size_t pos;
+
+    /**
+     * Read the next entry
+     *
+     * @returns The tag of the entry or '\0' if the payload is exhausted
+     */
+    char next(long long& i, unsigned long long& u, double& d, const char*& s)
+    {
+        if (pos >= len)
+            return '\0';
+
+        char tag = buf[pos++];
+        switch (tag)
+        {
+        case 'i':
+        case 'u':
+        case 'd':
+        case 'p':
+        {
+            if (pos + 8 > len)
+                return '\0';
+            memcpy(&u, buf + pos, 8);
+            pos += 8;
+            if (tag == 'd')
+            {
+                memcpy(&d, &u, 8);
+                i = (long long)d;
+                u = (unsigned long long)i;
+            }
+            else
+            {
+                i = (long long)u;
+                d = (tag == 'i') ? (double)i : (double)u;
+            }
+            s = NULL;
+            return tag;
+        }
+        case 's':
+        {
+            Uint16 slen;
+            if (pos + 2 > len)
+                return '\0';
+            memcpy(&slen, buf + pos, 2);
+            pos += 2;
+            if (pos + slen + 1 > len)
+                return '\0';
+            s = buf + pos;
+            pos += slen + 1;
+            i = 0;
+            u = 0;
+            d = 0.0;
+            return tag;
+        }
+        case 'n':
+            s = NULL;
+            i = 0;
+            u = 0;
+            d = 0.0;
+            return tag;
+        default:
+            pos = len;
+            return '\0';
+        }
+    }
+};
+
+size_t log_format::format(char* buf, size_t buf_len, const char* fmt, const char* payload, size_t payload_len)
+{
+    if (!buf_len)
+        return 0;
+
+    payload_reader_t r = { payload, payload_len, 0 };
+
+    size_t pos = 0;
+    const char* p = fmt;
+    while (*p && pos + 1 < buf_len)
+    {
+        if (*p != '%')
+        {
+            buf[pos++] = *p++;
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            buf[pos++] = '%';
+            p += 2;
+            continue;
+        }
+
+        spec_t spec;
+        parse_spec(p, spec);
+        p = spec.end;
+
+        long long i = 0;
+        unsigned long long u = 0;
+        double d = 0.0;
+        const char* s = NULL;
+
+        /* Rebuild the specification with '*' replaced by the captured values */
+        char spec_buf[64];
+        size_t spec_len = 0;
+        bool missing = false;
+        for (const char* c = spec.start; c < spec.end && spec_len + 24 < sizeof(spec_buf); c++)
+        {
+            if (*c != '*')
+            {
+                spec_buf[spec_len++] = *c;
+                continue;
+            }
+            if (!r.next(i, u, d, s))
+            {
+                missing = true;
+                break;
+            }
+            bool is_precision = (c > spec.start && c[-1] == '.');
+            if (is_precision && i < 0)
+                spec_len--;
+            else
+                spec_len += stbsp_snprintf(spec_buf + spec_len, sizeof(spec_buf) - spec_len, "%d", (int)i);
+        }
+        spec_buf[spec_len] = '\0';
+
+        char tag = '\0';
+        if (!missing && spec.conversion != 'n')
+            tag = r.next(i, u, d, s);
+
+        if (missing || (!tag && spec.conversion != 'n'))
+        {
+            size_t n = SDL_min(size_t(spec.end - spec.start), buf_len - pos - 1);
+            memcpy(buf + pos, spec.start, n);
+            pos += n;
+            continue;
+        }
+
+        const char* len = spec.length;
+        size_t len_n = spec.end - 1 - len;
+        bool len_long = (len_n == 1 && len[0] == 'l');
+        bool len_long_long = (len_n == 2 && len[0] == 'l') || (len_n && (len[0] == 'L' || len[0] == 'j' || len[0] == 'q')) || (len_n == 3 && len[1] == '6');
+        bool len_size = (len_n && (len[0] == 'z' || len[0] == 't')) || (len_n == 1 && len[0] == 'I');
+
+        char* out = buf + pos;
+        int out_len = (int)(buf_len - pos);
+        int written = 0;
+        switch (spec.conversion)
+        {
+        case 'd':
+        case 'i':
+            if (len_long_long)
+                written = stbsp_snprintf(out, out_len, spec_buf, (long long)i);
+            else if (len_size)
+                written = stbsp_snprintf(out, out_len, spec_buf, (ptrdiff_t)i);
+            else if (len_long)
+                written = stbsp_snprintf(out, out_len, spec_buf, (long)i);
+            else
+                written = stbsp_snprintf(out, out_len, spec_buf, (int)i);
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+        case 'b':
+        case 'B':
+            if (len_long_long)
+                written = stbsp_snprintf(out, out_len, spec_buf, (unsigned long long)u);
+            else if (len_size)
+                written = stbsp_snprintf(out, out_len, spec_buf, (size_t)u);
+            else if (len_long)
+                written = stbsp_snprintf(out, out_len, spec_buf, (unsigned long)u);
+            else
+                written = stbsp_snprintf(out, out_len, spec_buf, (unsigned int)u);
+            break;
+        case 'c':
+            written = stbsp_snprintf(out, out_len, spec_buf, (int)i);
+            break;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            written = stbsp_snprintf(out, out_len, spec_buf, d);
+            break;
+        case 'p':
+            written = stbsp_snprintf(out, out_len, spec_buf, (void*)(uintptr_t)u);
+            break;
+        case 's':
+            written = stbsp_snprintf(out, out_len, spec_buf, (tag == 's') ? s : (const char*)NULL);
+            break;
+        case 'n':
+            break;
+        default:
+            written = stbsp_snprintf(out, out_len, "%s", spec_buf);
+            break;
+        }
+        pos += SDL_min(size_t(SDL_max(written, 0)), buf_len - pos - 1);
+    }
+
+    buf[pos] = '\0';
+    return pos;
+}
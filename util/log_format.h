@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2026 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef TETRA__UTIL__LOG_FORMAT_H
+#define TETRA__UTIL__LOG_FORMAT_H
+
+#include "tetra/log.h"
+
+#include <stddef.h>
+
+/**
+ * Deferred printf style formatting for the dc_log macros
+ *
+ * The calling thread serializes the arguments with capture(), and whoever needs the text later calls format()
+ *
+ * Payload layout: For every argument consumed by the format string (Including '*' widths and precisions) a one byte tag followed by
+ * - 'i', 'u', 'd', 'p': 8 bytes holding a long long, unsigned long long, double, or pointer
+ * - 's': A Uint16 length followed by that many bytes and a null terminator
+ * - 'n': Nothing (A NULL string)
+ */
+struct log_format
+{
+    /**
+     * Serialize arguments for deferred formatting
+     *
+     * Strings consumed by %s conversions are copied (Respecting precision), everything else is stored by value
+     *
+     * The format string itself is not copied and must outlive the payload
+     *
+     * @param buf Buffer to write the payload to, if the payload does not fit then strings will be truncated or arguments dropped
+     * @param buf_len Size of buf
+     * @param fmt printf style format string
+     * @param args Arguments to serialize
+     * @param num_args Number of elements in args
+     *
+     * @returns Length of the payload written to buf
+     */
+    static size_t capture(char* buf, size_t buf_len, const char* fmt, const dev_console::log_arg_t* args, int num_args);
+
+    /**
+     * Format a payload created by capture()
+     *
+     * Conversions missing an argument in the payload are written out verbatim
+     *
+     * @param buf Buffer to write the formatted string to, this is always null terminated
+     * @param buf_len Size of buf
+     * @param fmt Format string that was passed to capture()
+     * @param payload Payload created by capture()
+     * @param payload_len Length of payload
+     *
+     * @returns Length of the string written to buf (excluding the null terminator)
+     */
+    static size_t format(char* buf, size_t buf_len, const char* fmt, const char* payload, size_t payload_len);
+};
+
+#endif
@@ -0,0 +1,336 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2026 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "log_recorder.h"
+
+#include "physfs.h"
+
+#include <SDL3/SDL_endian.h>
+#include <SDL3/SDL_time.h>
+#include <SDL3/SDL_timer.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#ifdef SDL_PLATFORM_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define LOG_RECORDER_MAGIC "TREC"
+#define LOG_RECORDER_VERSION 1
+#define LOG_RECORDER_HEADER_SIZE 64
+#define LOG_RECORDER_OFFSET_END 16
+#define LOG_RECORDER_MAX_TEXT 4096
+
+/* Length + type + time + level + length */
+#define LOG_RECORDER_TEXT_OVERHEAD (2 + 1 + 8 + 1 + 2)
+
+static void put_u16(Uint8* buf, Uint16 x)
+{
+    x = SDL_Swap16LE(x);
+    memcpy(buf, &x, 2);
+}
+
+static void put_u32(Uint8* buf, Uint32 x)
+{
+    x = SDL_Swap32LE(x);
+    memcpy(buf, &x, 4);
+}
+
+static void put_u64(Uint8* buf, Uint64 x)
+{
+    x = SDL_Swap64LE(x);
+    memcpy(buf, &x, 8);
+}
+
+static Uint16 get_u16(const Uint8* buf)
+{
+    Uint16 x;
+    memcpy(&x, buf, 2);
+    return SDL_Swap16LE(x);
+}
+
+static Uint32 get_u32(const Uint8* buf)
+{
+    Uint32 x;
+    memcpy(&x, buf, 4);
+    return SDL_Swap32LE(x);
+}
+
+static Uint64 get_u64(const Uint8* buf)
+{
+    Uint64 x;
+    memcpy(&x, buf, 8);
+    return SDL_Swap64LE(x);
+}
+
+bool log_recorder::open(const char* path, size_t size)
+{
+    close();
+
+    size_t file_size = LOG_RECORDER_HEADER_SIZE + size;
+    void* addr = NULL;
+
+#ifdef SDL_PLATFORM_WINDOWS
+    int wlen = MultiByteToWideChar(CP_UTF8, 0, path, -1, NULL, 0);
+    std::vector<wchar_t> wpath(SDL_max(wlen, 1));
+    MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath.data(), wlen);
+
+    HANDLE file = CreateFileW(wpath.data(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READWRITE, DWORD(Uint64(file_size) >> 32), DWORD(file_size & 0xFFFFFFFF), NULL);
+    if (mapping)
+        addr = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, file_size);
+
+    if (!addr)
+    {
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    handle_file = file;
+    handle_map = mapping;
+#else
+    int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+
+    if (ftruncate(fd, file_size) == 0)
+        addr = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (!addr || addr == MAP_FAILED)
+        return false;
+#endif
+
+    map = (Uint8*)addr;
+    map_size = file_size;
+    ring = map + LOG_RECORDER_HEADER_SIZE;
+    ring_size = size;
+    ring_end = 0;
+
+    SDL_Time now = 0;
+    SDL_GetCurrentTime(&now);
+
+    memset(map, 0, LOG_RECORDER_HEADER_SIZE);
+    memcpy(map, LOG_RECORDER_MAGIC, 4);
+    put_u32(map + 4, LOG_RECORDER_VERSION);
+    put_u64(map + 8, ring_size);
+    put_u64(map + LOG_RECORDER_OFFSET_END, 0);
+    put_u64(map + 24, now);
+    put_u64(map + 32, SDL_GetTicks());
+
+    return true;
+}
+
+void log_recorder::close()
+{
+    if (!map)
+        return;
+
+#ifdef SDL_PLATFORM_WINDOWS
+    UnmapViewOfFile(map);
+    CloseHandle(handle_map);
+    CloseHandle(handle_file);
+    handle_map = NULL;
+    handle_file = NULL;
+#else
+    munmap(map, map_size);
+#endif
+
+    map = NULL;
+    map_size = 0;
+    ring = NULL;
+    ring_size = 0;
+}
+
+void log_recorder::write_record(const Uint8* data, size_t len)
+{
+    size_t pos = ring_end % ring_size;
+    size_t first = SDL_min(len, ring_size - pos);
+    memcpy(ring + pos, data, first);
+    memcpy(ring, data + first, len - first);
+    ring_end += len;
+
+    /* The record must be complete before the header says it exists */
+    std::atomic_signal_fence(std::memory_order_release);
+    put_u64(map + LOG_RECORDER_OFFSET_END, ring_end);
+}
+
+void log_recorder::write_text(Uint64 ticks, int lvl, const char* text, size_t text_len)
+{
+    if (!map)
+        return;
+
+    text_len = SDL_min(text_len, SDL_min(size_t(LOG_RECORDER_MAX_TEXT), ring_size / 4));
+
+    Uint8 buf[LOG_RECORDER_MAX_TEXT + LOG_RECORDER_TEXT_OVERHEAD];
+    Uint16 len = Uint16(text_len + LOG_RECORDER_TEXT_OVERHEAD);
+    put_u16(buf, len);
+    buf[2] = RECORD_TEXT;
+    put_u64(buf + 3, ticks);
+    buf[11] = Uint8(Sint8(lvl));
+    memcpy(buf + 12, text, text_len);
+    put_u16(buf + 12 + text_len, len);
+
+    write_record(buf, len);
+}
+
+void log_recorder::write_repeat(Uint32 count)
+{
+    if (!map)
+        return;
+
+    Uint8 buf[2 + 1 + 4 + 2];
+    put_u16(buf, sizeof(buf));
+    buf[2] = RECORD_REPEAT;
+    put_u32(buf + 3, count);
+    put_u16(buf + 7, sizeof(buf));
+
+    write_record(buf, sizeof(buf));
+}
+
+bool log_recorder::read(const char* path, std::function<void(const message_t& msg)> callback)
+{
+    PHYSFS_File* fd = PHYSFS_openRead(path);
+    if (!fd)
+        return false;
+
+    std::vector<Uint8> data;
+    Sint64 fd_len = PHYSFS_fileLength(fd);
+    if (fd_len > 0)
+    {
+        data.resize(fd_len);
+        Sint64 bytes_read = PHYSFS_readBytes(fd, data.data(), data.size());
+        data.resize(SDL_max(bytes_read, Sint64(0)));
+    }
+    PHYSFS_close(fd);
+
+    if (data.size() < LOG_RECORDER_HEADER_SIZE || memcmp(data.data(), LOG_RECORDER_MAGIC, 4) != 0 || get_u32(data.data() + 4) != LOG_RECORDER_VERSION)
+        return false;
+
+    const Uint64 size = get_u64(data.data() + 8);
+    const Uint64 end = get_u64(data.data() + LOG_RECORDER_OFFSET_END);
+    const Sint64 session_time = Sint64(get_u64(data.data() + 24));
+    const Uint64 session_ticks = get_u64(data.data() + 32);
+    if (!size || size > data.size() - LOG_RECORDER_HEADER_SIZE)
+        return false;
+
+    const Uint8* ring = data.data() + LOG_RECORDER_HEADER_SIZE;
+    const Uint64 begin = (end > size) ? end - size : 0;
+
+    /* Copy a record out of the ring, undoing the wrap around */
+    std::vector<Uint8> rec;
+    auto copy_out = [&](Uint64 pos, size_t len) {
+        rec.resize(len);
+        for (size_t i = 0; i < len; i++)
+            rec[i] = ring[(pos + i) % size];
+    };
+
+    /* Walk backwards from the newest record, until a record is cut off by the oldest data */
+    std::vector<Uint64> starts;
+    Uint64 pos = end;
+    while (pos - begin >= 5)
+    {
+        copy_out(pos - 2, 2);
+        Uint16 len = get_u16(rec.data());
+        if (len < 5 || len > pos - begin)
+            break;
+
+        copy_out(pos - len, 2);
+        if (get_u16(rec.data()) != len)
+            break;
+
+        pos -= len;
+        starts.push_back(pos);
+    }
+
+    bool have_msg = false;
+    message_t msg;
+    std::string msg_text;
+
+    for (size_t i = starts.size(); i > 0; i--)
+    {
+        Uint64 start = starts[i - 1];
+        copy_out(start, 2);
+        copy_out(start, get_u16(rec.data()));
+
+        if (rec[2] == RECORD_REPEAT && rec.size() >= 9)
+        {
+            if (have_msg)
+                msg.repeat += get_u32(rec.data() + 3);
+            continue;
+        }
+
+        if (rec[2] != RECORD_TEXT || rec.size() < LOG_RECORDER_TEXT_OVERHEAD)
+            continue;
+
+        if (have_msg)
+            callback(msg);
+
+        Uint64 ticks = get_u64(rec.data() + 3);
+        msg.time = session_time + Sint64(ticks - session_ticks) * SDL_NS_PER_MS;
+        msg.lvl = Sint8(rec[11]);
+        msg.repeat = 1;
+        msg_text.assign((const char*)rec.data() + 12, rec.size() - LOG_RECORDER_TEXT_OVERHEAD);
+        msg.text = msg_text.c_str();
+        have_msg = true;
+    }
+
+    if (have_msg)
+        callback(msg);
+
+    return true;
+}
+
+bool log_recorder::copy_file(const char* src, const char* dst)
+{
+    PHYSFS_File* in = PHYSFS_openRead(src);
+    if (!in)
+        return false;
+
+    PHYSFS_File* out = PHYSFS_openWrite(dst);
+    if (!out)
+    {
+        PHYSFS_close(in);
+        return false;
+    }
+
+    bool ok = true;
+    char buf[16 * 1024];
+    Sint64 len;
+    while (ok && (len = PHYSFS_readBytes(in, buf, sizeof(buf))) > 0)
+        ok = PHYSFS_writeBytes(out, buf, len) == len;
+
+    if (len < 0)
+        ok = false;
+
+    PHYSFS_close(in);
+    return PHYSFS_close(out) && ok;
+}
@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2026 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef TETRA__UTIL__LOG_RECORDER_H
+#define TETRA__UTIL__LOG_RECORDER_H
+
+#include <SDL3/SDL_stdinc.h>
+#include <functional>
+
+/**
+ * Flight recorder for console messages, a ring of records in a memory mapped file
+ *
+ * Since the file is memory mapped, whatever was written before the process died is kept by the OS, even if the process
+ * was killed by a signal. Writing a record is a memcpy into the mapping and never makes a syscall
+ *
+ * The file is a header followed by the ring
+ * - Header: "TREC", Uint32 version, Uint64 ring size, Uint64 bytes ever written to the ring, Sint64 wall clock time (ns since
+ *   the unix epoch) and Uint64 SDL_GetTicks() when the file was created
+ * - Records: Uint16 length of the whole record, Uint8 type, fields, then the Uint16 length again so that the ring can be
+ *   walked backwards from the newest record
+ *   - RECORD_TEXT: Uint64 SDL_GetTicks(), Sint8 level, then the text up to the trailing length
+ *   - RECORD_REPEAT: Uint32 number of additional times the previous message was repeated
+ *
+ * All fields are little endian
+ */
+struct log_recorder
+{
+    enum record_type_t : Uint8
+    {
+        RECORD_TEXT = 'T',
+        RECORD_REPEAT = 'R',
+    };
+
+    ~log_recorder() { close(); }
+
+    /**
+     * Create a new ring file, replacing any existing file
+     *
+     * @param path Native path of the file
+     * @param ring_size Size of the ring in bytes
+     *
+     * @returns true on success
+     */
+    bool open(const char* path, size_t ring_size);
+
+    void close();
+
+    inline bool is_open() const { return map != NULL; }
+
+    /**
+     * Append a message, text longer than what fits in a single record is truncated
+     *
+     * Not thread safe, callers must serialize access
+     */
+    void write_text(Uint64 ticks, int lvl, const char* text, size_t text_len);
+
+    /**
+     * Record that the previous message was repeated count more times
+     *
+     * Not thread safe, callers must serialize access
+     */
+    void write_repeat(Uint32 count);
+
+    /**
+     * A message decoded by read()
+     */
+    struct message_t
+    {
+        /** Wall clock time in nanoseconds since the unix epoch */
+        Sint64 time;
+        int lvl;
+        const char* text;
+        Uint32 repeat;
+    };
+
+    /**
+     * Decode a ring file from the PhysFS search path
+     *
+     * @param path PhysFS path of the file
+     * @param callback Called for each surviving message, oldest first
+     *
+     * @returns false if the file could not be opened or is not a ring file
+     */
+    static bool read(const char* path, std::function<void(const message_t& msg)> callback);
+
+    /**
+     * Copy a file within the PhysFS write dir, used to keep the ring of the previous session before it is replaced
+     *
+     * @returns true on success
+     */
+    static bool copy_file(const char* src, const char* dst);
+
+private:
+    void write_record(const Uint8* data, size_t len);
+
+    /** Mapping of the whole file */
+    Uint8* map = NULL;
+    size_t map_size = 0;
+
+    /** Start of the ring in map */
+    Uint8* ring = NULL;
+    size_t ring_size = 0;
+
+    /** Bytes ever written to the ring, mirrored to the header after each record */
+    Uint64 ring_end = 0;
+
+#ifdef SDL_PLATFORM_WINDOWS
+    void* handle_file = NULL;
+    void* handle_map = NULL;
+#endif
+};
+
+#endif
@@ -21,12 +21,14 @@
  * DEALINGS IN THE SOFTWARE.
  */
 #include "misc.h"
+#include "tetra/log.h"
 #include <SDL3/SDL.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 void util::die(const char* fmt, ...)
 {
+    dev_console::try_flush_log();
     fflush(stdout);
     fputs("util::die(): >>>>>> Begin message <<<<<<\n", stdout);
     fflush(stdout);
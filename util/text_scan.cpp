@@ -0,0 +1,338 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2026 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "text_scan.h"
+
+#include <SDL3/SDL_cpuinfo.h>
+#include <SDL3/SDL_intrin.h>
+#include <SDL3/SDL_stdinc.h>
+
+static inline char lower_ascii(char c) { return (c >= 'A' && c <= 'Z') ? char(c | 0x20) : c; }
+
+static inline bool is_alpha_ascii(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+
+/**
+ * Compare len bytes of a with the lower case string b, ignoring ASCII case
+ */
+static inline bool equal_icase(const char* a, const char* b, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        if (lower_ascii(a[i]) != b[i])
+            return false;
+    return true;
+}
+
+static inline int lowest_bit(Uint32 x)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx;
+    _BitScanForward(&idx, x);
+    return int(idx);
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+static inline int popcount(Uint32 x)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    return int(__popcnt(x));
+#else
+    return __builtin_popcount(x);
+#endif
+}
+
+static inline int popcount64(Uint64 x)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    return popcount(Uint32(x)) + popcount(Uint32(x >> 32));
+#else
+    return __builtin_popcountll(x);
+#endif
+}
+
+static inline int lowest_bit64(Uint64 x)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    return (Uint32(x) != 0) ? lowest_bit(Uint32(x)) : 32 + lowest_bit(Uint32(x >> 32));
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+static const char* find_icase_scalar(const char* haystack, size_t haystack_len, const char* needle, size_t needle_len, size_t start)
+{
+    for (size_t i = start; i + needle_len <= haystack_len; i++)
+        if (lower_ascii(haystack[i]) == needle[0] && equal_icase(haystack + i + 1, needle + 1, needle_len - 1))
+            return haystack + i;
+    return NULL;
+}
+
+/*
+ * The vector paths compare the first and last bytes of the needle against 16 candidate positions at a time, and only
+ * verify the positions where both match
+ *
+ * Case is folded by OR'ing 0x20 into the haystack, which is only done for needle bytes that are letters
+ */
+
+const char* text_scan::find_icase(const char* haystack, size_t haystack_len, const char* needle, size_t needle_len)
+{
+    if (!needle_len)
+        return haystack;
+    if (needle_len > haystack_len)
+        return NULL;
+
+    size_t i = 0;
+
+#if defined(SDL_SSE2_INTRINSICS)
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+    const __m128i first_fold = _mm_set1_epi8(is_alpha_ascii(needle[0]) ? 0x20 : 0);
+    const __m128i last_fold = _mm_set1_epi8(is_alpha_ascii(needle[needle_len - 1]) ? 0x20 : 0);
+
+    for (; i + needle_len - 1 + 16 <= haystack_len; i += 16)
+    {
+        __m128i block_first = _mm_or_si128(_mm_loadu_si128((const __m128i*)(haystack + i)), first_fold);
+        __m128i block_last = _mm_or_si128(_mm_loadu_si128((const __m128i*)(haystack + i + needle_len - 1)), last_fold);
+        Uint32 mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last)));
+
+        while (mask)
+        {
+            int bit = lowest_bit(mask);
+            if (equal_icase(haystack + i + bit + 1, needle + 1, needle_len - 1))
+                return haystack + i + bit;
+            mask &= mask - 1;
+        }
+    }
+#elif defined(SDL_NEON_INTRINSICS)
+    const uint8x16_t first = vdupq_n_u8(needle[0]);
+    const uint8x16_t last = vdupq_n_u8(needle[needle_len - 1]);
+    const uint8x16_t first_fold = vdupq_n_u8(is_alpha_ascii(needle[0]) ? 0x20 : 0);
+    const uint8x16_t last_fold = vdupq_n_u8(is_alpha_ascii(needle[needle_len - 1]) ? 0x20 : 0);
+
+    for (; i + needle_len - 1 + 16 <= haystack_len; i += 16)
+    {
+        uint8x16_t block_first = vorrq_u8(vld1q_u8((const uint8_t*)(haystack + i)), first_fold);
+        uint8x16_t block_last = vorrq_u8(vld1q_u8((const uint8_t*)(haystack + i + needle_len - 1)), last_fold);
+        uint8x16_t eq = vandq_u8(vceqq_u8(block_first, first), vceqq_u8(block_last, last));
+
+        /* Narrow each byte of eq to a nibble, giving a 64 bit mask with 4 bits per position */
+        Uint64 mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        for (int bit = 0; mask; bit++, mask >>= 4)
+            if ((mask & 0xF) && equal_icase(haystack + i + bit + 1, needle + 1, needle_len - 1))
+                return haystack + i + bit;
+    }
+#endif
+
+    return find_icase_scalar(haystack, haystack_len, needle, needle_len, i);
+}
+
+/*
+ * The measure() paths share this accumulator, every path produces a pair of bitmasks for each block of bytes
+ * - newlines: bit set for every '\n'
+ * - starts: bit set for every byte that begins a codepoint, ie. is not a UTF-8 continuation byte (0b10xxxxxx)
+ */
+struct line_counter_t
+{
+    size_t num_newlines = 0;
+    size_t cur_len = 0;
+    size_t max_len = 0;
+
+    /**
+     * @param width Number of bytes in the block, at most 64
+     */
+    inline void add_block(Uint64 newlines, Uint64 starts, int width)
+    {
+        if (!newlines)
+        {
+            cur_len += popcount64(starts);
+            return;
+        }
+
+        int pos = 0;
+        while (newlines)
+        {
+            int bit = lowest_bit64(newlines);
+            Uint64 before = (bit ? (~Uint64(0) >> (64 - bit)) : 0) & ~(pos ? (~Uint64(0) >> (64 - pos)) : 0);
+            cur_len += popcount64(starts & before);
+            max_len = SDL_max(max_len, cur_len);
+            cur_len = 0;
+            num_newlines++;
+            pos = bit + 1;
+            newlines &= newlines - 1;
+        }
+
+        if (pos < width)
+            cur_len += popcount64(starts & ~(~Uint64(0) >> (64 - pos)));
+    }
+
+    inline void add_byte(char c)
+    {
+        if (c == '\n')
+        {
+            max_len = SDL_max(max_len, cur_len);
+            cur_len = 0;
+            num_newlines++;
+        }
+        else if ((c & 0xC0) != 0x80)
+            cur_len++;
+    }
+
+    inline text_scan::metrics_t finish(const char* text, size_t len)
+    {
+        text_scan::metrics_t m;
+        m.max_line_len = SDL_max(max_len, cur_len);
+        m.num_lines = num_newlines + ((len && text[len - 1] != '\n') ? 1 : 0);
+        if (!m.num_lines)
+            m.num_lines = 1;
+        return m;
+    }
+};
+
+text_scan::metrics_t text_scan::measure_scalar(const char* text, size_t len)
+{
+    line_counter_t counter;
+    for (size_t i = 0; i < len; i++)
+        counter.add_byte(text[i]);
+    return counter.finish(text, len);
+}
+
+#if defined(SDL_SSE2_INTRINSICS)
+static text_scan::metrics_t measure_sse2(const char* text, size_t len)
+{
+    line_counter_t counter;
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i cont_mask = _mm_set1_epi8(char(0xC0));
+    const __m128i cont = _mm_set1_epi8(char(0x80));
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)(text + i));
+        Uint32 newlines = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+        Uint32 conts = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(block, cont_mask), cont));
+        counter.add_block(newlines, ~conts & 0xFFFF, 16);
+    }
+
+    for (; i < len; i++)
+        counter.add_byte(text[i]);
+    return counter.finish(text, len);
+}
+#endif
+
+#if defined(SDL_AVX2_INTRINSICS)
+static text_scan::metrics_t SDL_TARGETING("avx2") measure_avx2(const char* text, size_t len)
+{
+    line_counter_t counter;
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i cont_mask = _mm256_set1_epi8(char(0xC0));
+    const __m256i cont = _mm256_set1_epi8(char(0x80));
+
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64)
+    {
+        __m256i lo = _mm256_loadu_si256((const __m256i*)(text + i));
+        __m256i hi = _mm256_loadu_si256((const __m256i*)(text + i + 32));
+        Uint64 newlines = Uint32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, newline)))
+            | (Uint64(Uint32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, newline)))) << 32);
+        Uint64 conts = Uint32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, cont_mask), cont)))
+            | (Uint64(Uint32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(hi, cont_mask), cont)))) << 32);
+        counter.add_block(newlines, ~conts, 64);
+    }
+
+    /* Short messages are common, so finish with 16 byte blocks */
+    const __m128i newline_16 = _mm_set1_epi8('\n');
+    const __m128i cont_mask_16 = _mm_set1_epi8(char(0xC0));
+    const __m128i cont_16 = _mm_set1_epi8(char(0x80));
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)(text + i));
+        Uint32 newlines = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline_16));
+        Uint32 conts = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(block, cont_mask_16), cont_16));
+        counter.add_block(newlines, ~conts & 0xFFFF, 16);
+    }
+
+    for (; i < len; i++)
+        counter.add_byte(text[i]);
+    return counter.finish(text, len);
+}
+#endif
+
+/* vmaxvq_u8() and vaddvq_u8() are AArch64 only */
+#if defined(SDL_NEON_INTRINSICS) && (defined(__aarch64__) || defined(_M_ARM64))
+#define TEXT_SCAN_NEON_MEASURE
+#endif
+
+#if defined(TEXT_SCAN_NEON_MEASURE)
+static text_scan::metrics_t measure_neon(const char* text, size_t len)
+{
+    line_counter_t counter;
+    const uint8x16_t newline = vdupq_n_u8('\n');
+    const uint8x16_t cont_mask = vdupq_n_u8(0xC0);
+    const uint8x16_t cont = vdupq_n_u8(0x80);
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        uint8x16_t block = vld1q_u8((const uint8_t*)(text + i));
+        uint8x16_t is_newline = vceqq_u8(block, newline);
+
+        /* Fast path, no newline so only the number of codepoint starts is needed */
+        if (!vmaxvq_u8(is_newline))
+        {
+            uint8x16_t is_start = vmvnq_u8(vceqq_u8(vandq_u8(block, cont_mask), cont));
+            counter.cur_len += vaddvq_u8(vshrq_n_u8(is_start, 7));
+            continue;
+        }
+
+        for (int k = 0; k < 16; k++)
+            counter.add_byte(text[i + k]);
+    }
+
+    for (; i < len; i++)
+        counter.add_byte(text[i]);
+    return counter.finish(text, len);
+}
+#endif
+
+typedef text_scan::metrics_t (*measure_func_t)(const char* text, size_t len);
+
+static measure_func_t pick_measure()
+{
+#if defined(SDL_AVX2_INTRINSICS)
+    if (SDL_HasAVX2())
+        return measure_avx2;
+#endif
+#if defined(SDL_SSE2_INTRINSICS)
+    return measure_sse2;
+#elif defined(TEXT_SCAN_NEON_MEASURE)
+    return measure_neon;
+#else
+    return text_scan::measure_scalar;
+#endif
+}
+
+text_scan::metrics_t text_scan::measure(const char* text, size_t len)
+{
+    static const measure_func_t func = pick_measure();
+    return func(text, len);
+}
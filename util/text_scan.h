@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2026 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef TETRA__UTIL__TEXT_SCAN_H
+#define TETRA__UTIL__TEXT_SCAN_H
+
+#include <stddef.h>
+
+/**
+ * Vectorized scans over text, with SSE2, AVX2, and NEON paths and a scalar fallback
+ */
+struct text_scan
+{
+    struct metrics_t
+    {
+        /** Number of lines, counted like ImGui::CalcTextSize() (A trailing newline does not start a new line), at least 1 */
+        size_t num_lines;
+
+        /** Number of UTF-8 codepoints in the longest line, excluding the newline */
+        size_t max_line_len;
+    };
+
+    /**
+     * Count lines and the UTF-8 codepoints of the longest line in a single pass
+     *
+     * Codepoints are counted as bytes that are not continuation bytes, so invalid sequences are not validated
+     *
+     * @param text Text to measure, need not be null terminated
+     * @param len Length of text
+     */
+    static metrics_t measure(const char* text, size_t len);
+
+    /**
+     * Scalar version of measure(), exposed for testing and benchmarking
+     */
+    static metrics_t measure_scalar(const char* text, size_t len);
+
+    /**
+     * Find the first occurrence of needle in haystack, ignoring ASCII case
+     *
+     * @param haystack Text to search
+     * @param haystack_len Length of haystack
+     * @param needle Text to search for, must already be lower case
+     * @param needle_len Length of needle
+     *
+     * @returns Pointer to the start of the match in haystack, or NULL if there is none (An empty needle matches at haystack)
+     */
+    static const char* find_icase(const char* haystack, size_t haystack_len, const char* needle, size_t needle_len);
+};
+
+#endif